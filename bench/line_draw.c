@@ -0,0 +1,96 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "app.h"
+#include "display.h"
+#include "player.h"
+#include "ray.h"
+
+#define NUM_FRAMES 2000
+
+/*
+ * Minimap line benchmark
+ * -------------------
+ * Times the minimap ray fan, NUM_RAYS lines from the player to the wall
+ * hits, drawn with draw_line() and with the float DDA it replaced (kept
+ * below for reference), while the player slowly turns. A second run uses
+ * long random lines mostly outside the window, the case the up-front
+ * clipping is for.
+ */
+
+static void drawLineDDA(int x0, int y0, int x1, int y1, uint32_t color) {
+    int delta_x = (x1 - x0);
+    int delta_y = (y1 - y0);
+
+    int longest_side_length = (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
+
+    float x_inc = delta_x / (float)longest_side_length;
+    float y_inc = delta_y / (float)longest_side_length;
+
+    float current_x = x0;
+    float current_y = y0;
+
+    for (int i = 0; i <= longest_side_length; i++) {
+        draw_pixel(round(current_x), round(current_y), color);
+        current_x += x_inc;
+        current_y += y_inc;
+    }
+}
+
+typedef void (*line_function_t)(int x0, int y0, int x1, int y1, uint32_t color);
+
+static double timeRayFan(line_function_t drawLine) {
+    initializePlayer();
+    setPlayerTurnDirection(PLAYER_TURN_DIRECTION_RIGHT);
+
+    double elapsed = 0;
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        movePlayer(0.001f);
+        castRays();
+        struct Player player = getPlayer();
+        clock_t start = clock();
+        for (int i = 0; i < NUM_RAYS; i++) {
+            drawLine(
+                player.minimap_x,
+                player.minimap_y,
+                getRayWallHitX(i) * ((float)MINIMAP_WIDTH_TILE_SIZE/TILE_SIZE),
+                getRayWallHitY(i) * ((float)MINIMAP_HEIGHT_TILE_SIZE/TILE_SIZE),
+                0xFF00FFFF
+            );
+        }
+        elapsed += (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+    return elapsed;
+}
+
+static double timeClippedLines(line_function_t drawLine) {
+    srand(1);
+    clock_t start = clock();
+    for (int i = 0; i < NUM_FRAMES * 10; i++) {
+        int x0 = rand() % (WINDOW_WIDTH * 8) - WINDOW_WIDTH * 4;
+        int y0 = rand() % (WINDOW_HEIGHT * 8) - WINDOW_HEIGHT * 4;
+        int x1 = rand() % (WINDOW_WIDTH * 8) - WINDOW_WIDTH * 4;
+        int y1 = rand() % (WINDOW_HEIGHT * 8) - WINDOW_HEIGHT * 4;
+        drawLine(x0, y0, x1, y1, 0xFF00FFFF);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+    if (!initializeWindow())
+        return 1;
+
+    double dda = timeRayFan(drawLineDDA);
+    double bresenham = timeRayFan(draw_line);
+    printf("ray fan, %d lines:      DDA %8.3f us/frame, Bresenham %8.3f us/frame\n",
+        NUM_RAYS, dda * 1e6 / NUM_FRAMES, bresenham * 1e6 / NUM_FRAMES);
+
+    dda = timeClippedLines(drawLineDDA);
+    bresenham = timeClippedLines(draw_line);
+    printf("clipped lines, %d lines: DDA %8.3f us/line,  Bresenham %8.3f us/line\n",
+        NUM_FRAMES * 10, dda * 1e6 / (NUM_FRAMES * 10), bresenham * 1e6 / (NUM_FRAMES * 10));
+
+    destroyResources();
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "app.h"
+#include "display.h"
+#include "map.h"
+#include "observation.h"
+
+#define FRAME_WIDTH 64
+#define FRAME_HEIGHT 40
+#define MAX_AGENTS 4096
+#define MIN_FRAMES 8192
+
+/*
+ * Observation throughput benchmark
+ * -------------------
+ * Renders FRAME_WIDTH x FRAME_HEIGHT first-person frames of K agents,
+ * placed at random open spots of the map, into one buffer with
+ * renderObservations(), for K = 1, 2, 4 ... MAX_AGENTS. One agent in 64
+ * has left the map and one is inside a wall of the border, their frames
+ * are skipped and left empty. Each batch size
+ * is repeated until at least MIN_FRAMES frames are drawn; the agents turn
+ * a little between batches. Times are wall clock.
+ */
+
+static camera_pose_t poses[MAX_AGENTS];
+
+static void placeAgents(void) {
+    srand(1);
+    for (int i = 0; i < MAX_AGENTS; i++) {
+        do {
+            poses[i].x = (float)rand() / RAND_MAX * MAP_WIDTH;
+            poses[i].y = (float)rand() / RAND_MAX * MAP_HEIGHT;
+        } while (mapHasWallAt(poses[i].x, poses[i].y));
+        poses[i].angle = (float)rand() / RAND_MAX * TWO_PI;
+        if (i % 64 == 31) {
+            poses[i].x = MAP_WIDTH - 0.001f;
+            poses[i].y = MAP_HEIGHT - 0.001f;
+        }
+        if (i % 64 == 63)
+            poses[i].x = -MAP_WIDTH;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    observation_renderer_t renderer;
+    if (!initializeHeadless(NULL) || !initObservationRenderer(&renderer, FRAME_WIDTH, FRAME_HEIGHT))
+        return 1;
+    uint32_t* frames = malloc(sizeof(uint32_t) * FRAME_WIDTH * FRAME_HEIGHT * MAX_AGENTS);
+    if (frames == NULL)
+        return 1;
+    placeAgents();
+
+    for (int numAgents = 1; numAgents <= MAX_AGENTS; numAgents *= 2) {
+        int numBatches = numAgents < MIN_FRAMES ? MIN_FRAMES / numAgents : 1;
+        uint64_t start = SDL_GetPerformanceCounter();
+        for (int batch = 0; batch < numBatches; batch++) {
+            for (int i = 0; i < numAgents; i++)
+                poses[i].angle += 0.01f;
+            renderObservations(&renderer, poses, numAgents, frames);
+        }
+        double elapsed = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        printf("K = %4d: %10.1f frames per second, %8.3f ms per batch\n",
+            numAgents, numAgents * numBatches / elapsed, elapsed * 1e3 / numBatches);
+    }
+
+    free(frames);
+    freeObservationRenderer(&renderer);
+    destroyResources();
+    return 0;
+}
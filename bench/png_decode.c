@@ -0,0 +1,578 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arena.h"
+#include "upng.h"
+
+#define MIN_BENCH_SECONDS 0.5
+// Times every game texture is loaded in the allocation benchmark
+#define LOAD_ROUNDS 100
+#define LZ_HASH_BITS 15
+#define LZ_WINDOW 32768
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 258
+// Width of the images of the dynamic block header check
+#define HEADER_CHECK_WIDTH 64
+
+/*
+ * PNG decode benchmark
+ * -------------------
+ * Times upng_decode() on the game textures, on large synthetic images and
+ * on any PNG file given in the command line, and reports the throughput in
+ * MB of decoded pixels per second and the peak memory of a decode.
+ *
+ * The synthetic images are RGB and RGBA gradients with noise, with every
+ * scanline filter type in turn, deflated by the small greedy LZ77 + fixed
+ * Huffman encoder below, so the benchmark doesn't need zlib to produce PNGs
+ * big enough to measure the inflate and unfilter loops.
+ *
+ * It also loads the game textures LOAD_ROUNDS times from their files, as
+ * the texture loader does, once with upng allocating from the heap and
+ * once from a scratch arena reset between images, and reports the
+ * allocations and the peak memory of both.
+ *
+ * Before timing, it decodes small images whose pixels are in a dynamic
+ * Huffman block that sends all 19 code length codes, the block starting
+ * at every bit offset, and checks the pixels: the header is the longest
+ * run of bits inflate reads without decoding a symbol.
+ */
+
+static const char* assetFileNames[] = {
+    "./assets/wall-stone.png",
+    "./assets/brick-grey.png",
+    "./assets/brick-red.png",
+    "./assets/metallic-door.png",
+    "./assets/armor.png",
+    "./assets/barrel.png",
+    "./assets/bones.png",
+    "./assets/hanged.png",
+    "./assets/guard-spritesheet.png",
+};
+
+static const unsigned lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+    67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+    4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+    769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8,
+    8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    uint32_t bits;
+    int count;
+} byte_writer_t;
+
+static void putByte(byte_writer_t* w, unsigned char byte) {
+    if (w->size == w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 4096;
+        w->data = realloc(w->data, w->capacity);
+        if (w->data == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    w->data[w->size++] = byte;
+}
+
+static void putBytes(byte_writer_t* w, const void* bytes, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        putByte(w, ((const unsigned char*)bytes)[i]);
+}
+
+static void putUint32BE(byte_writer_t* w, uint32_t value) {
+    putByte(w, value >> 24);
+    putByte(w, value >> 16);
+    putByte(w, value >> 8);
+    putByte(w, value);
+}
+
+// Deflate bit fields are packed LSB first
+static void putBits(byte_writer_t* w, uint32_t value, int nbits) {
+    w->bits |= value << w->count;
+    w->count += nbits;
+    while (w->count >= 8) {
+        putByte(w, w->bits & 0xFF);
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+// Huffman codes are packed MSB first
+static void putCode(byte_writer_t* w, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    putBits(w, reversed, length);
+}
+
+static void flushBits(byte_writer_t* w) {
+    if (w->count > 0)
+        putBits(w, 0, 8 - w->count);
+}
+
+static void putLiteralLength(byte_writer_t* w, unsigned symbol) {
+    if (symbol < 144)
+        putCode(w, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        putCode(w, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        putCode(w, symbol - 256, 7);
+    else
+        putCode(w, 0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(byte_writer_t* w, unsigned length, unsigned distance) {
+    int l = 28, d = 29;
+    while (lengthBase[l] > length)
+        l--;
+    while (distanceBase[d] > distance)
+        d--;
+    putLiteralLength(w, 257 + l);
+    putBits(w, length - lengthBase[l], lengthExtra[l]);
+    putCode(w, d, 5);
+    putBits(w, distance - distanceBase[d], distanceExtra[d]);
+}
+
+/*
+ * Function: deflateFixed
+ * -------------------
+ * Compresses data as a zlib stream of a single fixed Huffman block, with a
+ * greedy LZ77 search that only remembers the last position of every hash.
+ */
+static void deflateFixed(byte_writer_t* w, const unsigned char* data, size_t size) {
+    static int32_t head[1 << LZ_HASH_BITS];
+    uint32_t a = 1, b = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+        head[i] = -1;
+
+    putByte(w, 0x78);
+    putByte(w, 0x01);
+    putBits(w, 1, 1);   // Final block
+    putBits(w, 1, 2);   // Fixed Huffman codes
+
+    size_t pos = 0;
+    while (pos < size) {
+        unsigned bestLength = 0, bestDistance = 0;
+        if (pos + LZ_MIN_MATCH <= size) {
+            uint32_t hash = ((data[pos] << 16 | data[pos + 1] << 8 | data[pos + 2]) * 2654435761u) >> (32 - LZ_HASH_BITS);
+            int32_t candidate = head[hash];
+            head[hash] = (int32_t)pos;
+            if (candidate >= 0 && pos - candidate <= LZ_WINDOW) {
+                size_t maxLength = size - pos < LZ_MAX_MATCH ? size - pos : LZ_MAX_MATCH;
+                unsigned length = 0;
+                while (length < maxLength && data[candidate + length] == data[pos + length])
+                    length++;
+                if (length >= LZ_MIN_MATCH) {
+                    bestLength = length;
+                    bestDistance = pos - candidate;
+                }
+            }
+        }
+        if (bestLength > 0) {
+            putMatch(w, bestLength, bestDistance);
+            pos += bestLength;
+        } else {
+            putLiteralLength(w, data[pos]);
+            pos++;
+        }
+    }
+    putLiteralLength(w, 256);
+    flushBits(w);
+
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putUint32BE(w, b << 16 | a);
+}
+
+/*
+ * Function: deflateDynamicHeader
+ * -------------------
+ * Compresses data as a zlib stream whose first numPrefixBlocks bytes are
+ * fixed Huffman blocks of one literal each, shifting the start of the last
+ * block, and whose other bytes are a dynamic Huffman block with hclen 19.
+ * Its literals 0 to 254 have 8 bit codes, literal 255 and the end of block
+ * 9 bit codes; the code length codes 1, 8, 9 and 15 are 2 bits each.
+ */
+static void deflateDynamicHeader(byte_writer_t* w, const unsigned char* data, size_t size, int numPrefixBlocks) {
+    static const int codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint32_t a = 1, b = 0;
+
+    putByte(w, 0x78);
+    putByte(w, 0x01);
+    for (int i = 0; i < numPrefixBlocks; i++) {
+        putBits(w, 0, 1);
+        putBits(w, 1, 2);   // Fixed Huffman codes
+        putLiteralLength(w, data[i]);
+        putLiteralLength(w, 256);
+    }
+
+    putBits(w, 1, 1);       // Final block
+    putBits(w, 2, 2);       // Dynamic Huffman codes
+    putBits(w, 257 - 257, 5);
+    putBits(w, 1 - 1, 5);
+    putBits(w, 19 - 4, 4);
+    for (int i = 0; i < 19; i++) {
+        int symbol = codeLengthOrder[i];
+        putBits(w, symbol == 1 || symbol == 8 || symbol == 9 || symbol == 15 ? 2 : 0, 3);
+    }
+    // Code length codes 1, 8, 9, 15 are 00, 01, 10, 11
+    for (int i = 0; i < 255; i++)
+        putCode(w, 1, 2);   // Literals 0 to 254: 8 bits
+    putCode(w, 2, 2);       // Literal 255 and end of block: 9 bits
+    putCode(w, 2, 2);
+    putCode(w, 0, 2);       // The only distance code: 1 bit
+    for (size_t i = numPrefixBlocks; i < size; i++) {
+        if (data[i] < 255)
+            putCode(w, data[i], 8);
+        else
+            putCode(w, 510, 9);
+    }
+    putCode(w, 511, 9);
+    flushBits(w);
+
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putUint32BE(w, b << 16 | a);
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void putChunk(byte_writer_t* w, const char* type, const unsigned char* data, size_t size) {
+    putUint32BE(w, size);
+    size_t start = w->size;
+    putBytes(w, type, 4);
+    putBytes(w, data, size);
+    putUint32BE(w, crc32(w->data + start, w->size - start));
+}
+
+static int paethPredictor(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/*
+ * Function: filterScanline
+ * -------------------
+ * Applies a PNG filter type to one scanline (prev is NULL for the first one)
+ */
+static void filterScanline(unsigned char* out, const unsigned char* row, const unsigned char* prev, size_t length, int bytewidth, int filterType) {
+    for (size_t i = 0; i < length; i++) {
+        int a = i >= (size_t)bytewidth ? row[i - bytewidth] : 0;
+        int b = prev ? prev[i] : 0;
+        int c = prev && i >= (size_t)bytewidth ? prev[i - bytewidth] : 0;
+        int predictor = 0;
+        switch (filterType) {
+            case 1: predictor = a; break;
+            case 2: predictor = b; break;
+            case 3: predictor = (a + b) / 2; break;
+            case 4: predictor = paethPredictor(a, b, c); break;
+        }
+        out[i] = (unsigned char)(row[i] - predictor);
+    }
+}
+
+/*
+ * Function: makeSyntheticPng
+ * -------------------
+ * Encodes a size x size 8 bit RGB (3 channels) or RGBA (4 channels) image
+ * of smooth gradients with some noise, scanline y with filter type y % 5
+ *
+ * returns: unsigned char* PNG file bytes (free() them), its length in *pngSize
+ */
+static unsigned char* makeSyntheticPng(unsigned size, int channels, size_t* pngSize) {
+    size_t length = (size_t)size * channels;
+    size_t stride = 1 + length;
+    unsigned char* pixels = malloc(length * size);
+    unsigned char* raw = malloc(stride * size);
+    byte_writer_t png = { 0 };
+    byte_writer_t idat = { 0 };
+
+    srand(size);
+    for (unsigned y = 0; y < size; y++) {
+        unsigned char* row = pixels + y * length;
+        for (unsigned x = 0; x < size; x++) {
+            unsigned noise = (rand() & 7) == 0 ? rand() & 0x0F : 0;
+            row[x * channels + 0] = (x * 255 / size + noise) & 0xFF;
+            row[x * channels + 1] = (y * 255 / size) & 0xFF;
+            row[x * channels + 2] = ((x ^ y) >> 4) & 0xFF;
+            if (channels == 4)
+                row[x * channels + 3] = 0xFF;
+        }
+        raw[y * stride] = y % 5;
+        filterScanline(raw + y * stride + 1, row, y > 0 ? row - length : NULL, length, channels, y % 5);
+    }
+
+    unsigned char header[13] = {
+        size >> 24, size >> 16, size >> 8, size,
+        size >> 24, size >> 16, size >> 8, size,
+        8,                          // Bit depth
+        channels == 4 ? 6 : 2,      // Color type RGBA or RGB
+        0, 0, 0
+    };
+    putBytes(&png, "\x89PNG\r\n\x1a\n", 8);
+    putChunk(&png, "IHDR", header, sizeof(header));
+    deflateFixed(&idat, raw, stride * size);
+    putChunk(&png, "IDAT", idat.data, idat.size);
+    putChunk(&png, "IEND", NULL, 0);
+
+    free(pixels);
+    free(raw);
+    free(idat.data);
+    *pngSize = png.size;
+    return png.data;
+}
+
+/*
+ * Function: checkDynamicHeaders
+ * -------------------
+ * Decodes a HEADER_CHECK_WIDTH x 1 grayscale image from deflateDynamicHeader()
+ * for every number of prefix blocks up to 15, and compares the pixels
+ *
+ * returns: int Number of images that failed to decode or decoded wrong
+ */
+static int checkDynamicHeaders() {
+    unsigned char raw[1 + HEADER_CHECK_WIDTH];
+    unsigned char header[13] = { 0, 0, 0, HEADER_CHECK_WIDTH, 0, 0, 0, 1, 8, 0, 0, 0, 0 };
+    int numFailed = 0;
+
+    raw[0] = 0;     // Filter type none
+    for (int x = 0; x < HEADER_CHECK_WIDTH; x++)
+        raw[1 + x] = x < 16 ? 200 : (x * 37) % 256;
+
+    for (int numPrefixBlocks = 0; numPrefixBlocks < 16; numPrefixBlocks++) {
+        byte_writer_t png = { 0 };
+        byte_writer_t idat = { 0 };
+        putBytes(&png, "\x89PNG\r\n\x1a\n", 8);
+        putChunk(&png, "IHDR", header, sizeof(header));
+        deflateDynamicHeader(&idat, raw, sizeof(raw), numPrefixBlocks);
+        putChunk(&png, "IDAT", idat.data, idat.size);
+        putChunk(&png, "IEND", NULL, 0);
+
+        upng_t* upng = upng_new_from_bytes(png.data, png.size);
+        if (upng == NULL || upng_decode(upng) != UPNG_EOK ||
+            memcmp(upng_get_buffer(upng), raw + 1, HEADER_CHECK_WIDTH) != 0) {
+            printf("dynamic block header after %2d blocks: decode error %d\n", numPrefixBlocks,
+                upng ? upng_get_error(upng) : UPNG_ENOMEM);
+            numFailed++;
+        }
+        if (upng != NULL)
+            upng_free(upng);
+        free(png.data);
+        free(idat.data);
+    }
+    return numFailed;
+}
+
+static unsigned char* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* data = malloc(*size);
+    if (data != NULL && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Heap allocator for upng that counts allocations and live bytes
+typedef struct {
+    int numAllocations;
+    size_t liveBytes;
+    size_t peakBytes;
+} heap_counter_t;
+
+static void* countingAlloc(void* user, unsigned long size) {
+    heap_counter_t* counter = user;
+    size_t* block = malloc(sizeof(size_t) * 2 + size);     // Size header, keeps 16 byte alignment
+    if (block == NULL)
+        return NULL;
+    block[0] = size;
+    counter->numAllocations++;
+    counter->liveBytes += size;
+    counter->peakBytes = counter->liveBytes > counter->peakBytes ? counter->liveBytes : counter->peakBytes;
+    return block + 2;
+}
+
+static void countingFree(void* user, void* ptr) {
+    heap_counter_t* counter = user;
+    if (ptr == NULL)
+        return;
+    size_t* block = (size_t*)ptr - 2;
+    counter->liveBytes -= block[0];
+    free(block);
+}
+
+/*
+ * Function: benchmark
+ * -------------------
+ * Decodes the PNG bytes over and over for at least MIN_BENCH_SECONDS
+ */
+static void benchmark(const char* name, const unsigned char* png, size_t pngSize) {
+    unsigned width = 0, height = 0, decodedSize = 0;
+    int iterations = 0;
+    double elapsed = 0;
+
+    clock_t start = clock();
+    do {
+        upng_t* upng = upng_new_from_bytes(png, pngSize);
+        if (upng == NULL || upng_decode(upng) != UPNG_EOK) {
+            printf("%-36s decode error %d\n", name, upng ? upng_get_error(upng) : UPNG_ENOMEM);
+            if (upng != NULL)
+                upng_free(upng);
+            return;
+        }
+        width = upng_get_width(upng);
+        height = upng_get_height(upng);
+        decodedSize = upng_get_size(upng);
+        upng_free(upng);
+        iterations++;
+        elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < MIN_BENCH_SECONDS);
+
+    // One more decode to measure the memory upng needs at once
+    heap_counter_t counter = { 0 };
+    upng_allocator allocator = { countingAlloc, countingFree, &counter };
+    upng_t* upng = upng_new_from_bytes_with_allocator(png, pngSize, &allocator);
+    if (upng != NULL) {
+        upng_decode(upng);
+        upng_free(upng);
+    }
+
+    printf("%-36s %5ux%-5u %8.3f ms/decode %8.1f MB/s %9zu bytes peak\n", name, width, height,
+        elapsed * 1e3 / iterations, (double)decodedSize * iterations / elapsed / 1e6, counter.peakBytes);
+}
+
+static void* arenaAllocCallback(void* user, unsigned long size) {
+    return arenaAlloc(user, size);
+}
+
+static void arenaFreeCallback(void* user, void* ptr) {
+    arenaFree(user, ptr);
+}
+
+/*
+ * Function: loadTextures
+ * -------------------
+ * Decodes every game texture LOAD_ROUNDS times with an allocator
+ *
+ * returns: int Number of textures decoded, 0 if any failed
+ */
+static int loadTextures(const upng_allocator* allocator, arena_t* arena) {
+    int numLoaded = 0;
+    for (int round = 0; round < LOAD_ROUNDS; round++) {
+        for (size_t i = 0; i < sizeof(assetFileNames) / sizeof(assetFileNames[0]); i++) {
+            upng_t* upng = upng_new_from_file_with_allocator(assetFileNames[i], allocator);
+            upng_error error = upng != NULL ? upng_decode(upng) : UPNG_ENOMEM;
+            if (upng != NULL)
+                upng_free(upng);
+            if (arena != NULL)
+                resetArena(arena);
+            if (error != UPNG_EOK)
+                return 0;
+            numLoaded++;
+        }
+    }
+    return numLoaded;
+}
+
+static void benchmarkLoad() {
+    heap_counter_t counter = { 0 };
+    upng_allocator heap = { countingAlloc, countingFree, &counter };
+    arena_t arena;
+    initArena(&arena, 0);
+    upng_allocator scratch = { arenaAllocCallback, arenaFreeCallback, &arena };
+
+    clock_t start = clock();
+    int numLoaded = loadTextures(&heap, NULL);
+    double heapElapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    loadTextures(&scratch, &arena);
+    double arenaElapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (numLoaded == 0) {
+        printf("texture load: textures not found\n");
+    } else {
+        printf("texture load, %d textures: heap  %7d mallocs, %8zu bytes peak, %8.3f ms\n",
+            numLoaded, counter.numAllocations, counter.peakBytes, heapElapsed * 1e3);
+        printf("texture load, %d textures: arena %7d mallocs, %8zu bytes peak, %8.3f ms\n",
+            numLoaded, arena.numHeapAllocations, arena.peakBytes, arenaElapsed * 1e3);
+    }
+    freeArena(&arena);
+}
+
+int main(int argc, char *argv[]) {
+    struct { unsigned size; int channels; } synthetic[] = { { 1024, 4 }, { 2048, 4 }, { 2048, 3 } };
+
+    if (checkDynamicHeaders() > 0)
+        return 1;
+
+    for (size_t i = 0; i < sizeof(assetFileNames) / sizeof(assetFileNames[0]); i++) {
+        size_t size;
+        unsigned char* png = readFile(assetFileNames[i], &size);
+        if (png == NULL) {
+            printf("%-36s not found\n", assetFileNames[i]);
+            continue;
+        }
+        benchmark(assetFileNames[i], png, size);
+        free(png);
+    }
+
+    for (size_t i = 0; i < sizeof(synthetic) / sizeof(synthetic[0]); i++) {
+        char name[64];
+        size_t size;
+        unsigned char* png = makeSyntheticPng(synthetic[i].size, synthetic[i].channels, &size);
+        snprintf(name, sizeof(name), "synthetic %s %ux%u", synthetic[i].channels == 4 ? "RGBA" : "RGB",
+            synthetic[i].size, synthetic[i].size);
+        benchmark(name, png, size);
+        free(png);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        size_t size;
+        unsigned char* png = readFile(argv[i], &size);
+        if (png == NULL) {
+            printf("%-36s not found\n", argv[i]);
+            continue;
+        }
+        benchmark(argv[i], png, size);
+        free(png);
+    }
+
+    benchmarkLoad();
+    return 0;
+}
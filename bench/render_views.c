@@ -0,0 +1,69 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "app.h"
+#include "display.h"
+#include "player.h"
+#include "render.h"
+
+#define NUM_FRAMES 60
+#define MAX_VIEWS 32
+
+/*
+ * Render context benchmark
+ * -------------------
+ * Draws N views of the level, each from its own camera placed around the
+ * player start and slowly turning, into its own frame. The views are
+ * drawn one renderViews() call at a time, all on the calling thread, and
+ * then all in one call spread over the CPUs. Times are wall clock.
+ */
+
+static render_context_t contexts[MAX_VIEWS];
+static render_context_t* views[MAX_VIEWS];
+
+static void placeCameras(int numViews, int frame) {
+    struct Player player = getPlayer();
+    for (int i = 0; i < numViews; i++) {
+        float angle = (TWO_PI * i) / numViews + frame * 0.01f;
+        setRenderCamera(views[i], player.x, player.y, angle);
+    }
+}
+
+static double timeViews(int numViews, bool together) {
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        placeCameras(numViews, frame);
+        if (together) {
+            renderViews(views, numViews);
+        } else {
+            for (int i = 0; i < numViews; i++)
+                renderViews(&views[i], 1);
+        }
+    }
+    return (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char *argv[]) {
+    if (!initializeHeadless(NULL))
+        return 1;
+    initializePlayer();
+
+    for (int i = 0; i < MAX_VIEWS; i++) {
+        views[i] = &contexts[i];
+        if (!initRenderContext(views[i], NULL, WINDOW_WIDTH, WINDOW_HEIGHT))
+            return 1;
+        views[i]->showMiniMap = i % 2 == 1;
+    }
+
+    for (int numViews = 1; numViews <= MAX_VIEWS; numViews *= 2) {
+        double serial = timeViews(numViews, false);
+        double threaded = timeViews(numViews, true);
+        printf("%2d views: serial %8.1f views/s, renderViews %8.1f views/s (%.2fx)\n",
+            numViews, numViews * NUM_FRAMES / serial, numViews * NUM_FRAMES / threaded, serial / threaded);
+    }
+
+    for (int i = 0; i < MAX_VIEWS; i++)
+        freeRenderContext(views[i]);
+    destroyResources();
+    return 0;
+}
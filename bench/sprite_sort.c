@@ -0,0 +1,51 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "app.h"
+#include "player.h"
+#include "sprite.h"
+
+#define NUM_FRAMES 500
+
+/*
+ * Sprite depth sort benchmark
+ * -------------------
+ * Spawns N sprites inside the player FoV and times updateSprites() (the
+ * visibility test plus the back to front sort) while the player slowly
+ * turns, so the order changes a little every frame like it does in game.
+ */
+static void benchmark(int numSprites) {
+    struct Player player;
+
+    freeSprites();
+    initializePlayer();
+    player = getPlayer();
+    initSprites(numSprites);
+    srand(1);
+    for (int i = 0; i < numSprites; i++) {
+        float angle = player.rotationAngle + ((float)rand() / RAND_MAX - 0.5f) * 0.6f;
+        float distance = 50 + ((float)rand() / RAND_MAX) * 2000;
+        spawnSprite(player.x + cos(angle) * distance, player.y + sin(angle) * distance, 4);
+    }
+
+    setPlayerTurnDirection(PLAYER_TURN_DIRECTION_RIGHT);
+    updateSprites(0);
+    clock_t start = clock();
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        movePlayer(0.0001f);
+        updateSprites(0);
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%6d sprites, %6d visible: %8.3f us/frame\n",
+        numSprites, getNumVisibleSprites(), elapsed * 1e6 / NUM_FRAMES);
+}
+
+int main(int argc, char *argv[]) {
+    int counts[] = { 16, 128, 1024, 10000 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        benchmark(counts[i]);
+    freeSprites();
+    return 0;
+}
@@ -19,8 +19,10 @@ struct Game {
 #define MAP_NUM_COLS 20
 #define MAP_WIDTH (TILE_SIZE * MAP_NUM_COLS)
 #define MAP_HEIGHT (TILE_SIZE * MAP_NUM_ROWS)
-#define MINIMAP_WIDTH_TILE_SIZE (WINDOW_WIDTH / MAP_NUM_COLS)
-#define MINIMAP_HEIGHT_TILE_SIZE (WINDOW_HEIGHT / MAP_NUM_ROWS)
+#define MINIMAP_WIDTH_TILE_SIZE 32
+#define MINIMAP_HEIGHT_TILE_SIZE 32
+#define MINIMAP_WIDTH (MINIMAP_WIDTH_TILE_SIZE * MAP_NUM_COLS)
+#define MINIMAP_HEIGHT (MINIMAP_HEIGHT_TILE_SIZE * MAP_NUM_ROWS)
 
 // Math constants
 #define PI 3.14159265
@@ -28,7 +30,8 @@ struct Game {
 #define FRAME_TIME_LENGTH (1000 / FPS)
 #define FOV_ANGLE (60 * (PI/180))
 #define NUM_RAYS WINDOW_WIDTH
-#define DIST_PROJ_PLANE ((WINDOW_WIDTH/2)/tan(FOV_ANGLE/2))
+#define DIST_PROJ_PLANE_FOR(width) (((width)/2)/tan(FOV_ANGLE/2))
+#define DIST_PROJ_PLANE DIST_PROJ_PLANE_FOR(WINDOW_WIDTH)
 
 // Player movements
 #define PLAYER_TURN_DIRECTION_LEFT -1
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/*
+ * Function: initArena
+ * -------------------
+ * Initializes an empty arena. The block is allocated by the first reset
+ * that needs it, or right away if a capacity is given.
+ * 
+ * arena_t* arena: Arena
+ * size_t capacity: Initial block size in bytes, 0 to size it by use
+ * 
+ * returns: void
+ */
+void initArena(arena_t* arena, size_t capacity) {
+    memset(arena, 0, sizeof(*arena));
+    if (capacity > 0) {
+        arena->block = malloc(capacity);
+        arena->capacity = arena->block != NULL ? capacity : 0;
+        arena->numHeapAllocations++;
+    }
+}
+
+/*
+ * Function: arenaAlloc
+ * -------------------
+ * Allocates from the block, or from the heap if the block is full
+ * 
+ * arena_t* arena: Arena
+ * size_t size: Bytes
+ * 
+ * returns: void* ARENA_ALIGNMENT aligned memory, NULL if out of memory
+ */
+void* arenaAlloc(arena_t* arena, size_t size) {
+    size_t alignedSize = (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    void* ptr;
+
+    arena->numAllocations++;
+    if (arena->used + alignedSize <= arena->capacity) {
+        ptr = arena->block + arena->used;
+        arena->used += alignedSize;
+    } else {
+        ptr = malloc(alignedSize);
+        if (ptr == NULL)
+            return NULL;
+        arena->numHeapAllocations++;
+        arena->overflowBytes += alignedSize;
+    }
+
+    size_t inUse = arena->used + arena->overflowBytes;
+    arena->highWater = inUse > arena->highWater ? inUse : arena->highWater;
+    arena->peakBytes = inUse > arena->peakBytes ? inUse : arena->peakBytes;
+    return ptr;
+}
+
+/*
+ * Function: arenaFree
+ * -------------------
+ * Frees memory the block couldn't hold. Memory inside the block is only
+ * released by resetArena(), so this does nothing for it.
+ * 
+ * arena_t* arena: Arena
+ * void* ptr: Memory returned by arenaAlloc(), or NULL
+ * 
+ * returns: void
+ */
+void arenaFree(arena_t* arena, void* ptr) {
+    unsigned char* bytes = ptr;
+    if (ptr == NULL || (bytes >= arena->block && bytes < arena->block + arena->capacity))
+        return;
+    // The size isn't known here; overflow is accounted as released at the next reset
+    free(ptr);
+}
+
+/*
+ * Function: resetArena
+ * -------------------
+ * Releases everything allocated from the block. If the last use didn't
+ * fit, the block is replaced by one as big as the high-water mark.
+ * 
+ * arena_t* arena: Arena, with every overflow allocation already freed
+ * 
+ * returns: void
+ */
+void resetArena(arena_t* arena) {
+    if (arena->highWater > arena->capacity) {
+        unsigned char* block = malloc(arena->highWater);
+        if (block != NULL) {
+            free(arena->block);
+            arena->block = block;
+            arena->capacity = arena->highWater;
+            arena->numHeapAllocations++;
+        }
+    }
+    arena->used = 0;
+    arena->overflowBytes = 0;
+    arena->highWater = 0;
+}
+
+void freeArena(arena_t* arena) {
+    free(arena->block);
+    memset(arena, 0, sizeof(*arena));
+}
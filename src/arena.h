@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Alignment of every allocation
+#define ARENA_ALIGNMENT 16
+
+// Scratch arena: allocations bump a pointer through one block and are all
+// released together by resetArena(). Requests that don't fit are served by
+// malloc() and must be given back with arenaFree(); the block grows to
+// the high-water mark on the next reset, so a reused arena stops
+// overflowing after its largest job.
+typedef struct {
+    unsigned char* block;
+    size_t capacity;
+    size_t used;
+    size_t overflowBytes;       // Live bytes served by malloc() since the last reset
+    size_t highWater;           // Most bytes needed at once since the last reset
+    int numAllocations;         // Allocations requested, counted until freeArena()
+    int numHeapAllocations;     // Calls to malloc(): block growth and overflow
+    size_t peakBytes;           // Most bytes needed at once, over the arena lifetime
+} arena_t;
+
+void initArena(arena_t* arena, size_t capacity);
+void* arenaAlloc(arena_t* arena, size_t size);
+void arenaFree(arena_t* arena, void* ptr);
+void resetArena(arena_t* arena);
+void freeArena(arena_t* arena);
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assetpack.h"
+#include "mapfile.h"
+
+// Pack file layout:
+//   asset_pack_header_t
+//   asset_pack_entry_t[numAssets], sorted by name
+//   data of every asset, each one starting on an ASSET_PACK_ALIGNMENT boundary
+// An asset id is the index of its entry, and its data is used in place
+// from the mapped file.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t numAssets;
+    uint32_t reserved;
+} asset_pack_header_t;
+
+typedef struct {
+    char name[ASSET_PACK_NAME_LENGTH];      // Path relative to the assets directory
+    uint32_t type;                          // asset_type_t
+    uint32_t reserved;
+    uint64_t offset;                        // Data offset from the start of the file
+    uint64_t size;
+} asset_pack_entry_t;
+
+static const char ASSET_PACK_MAGIC[4] = { 'R', 'C', 'P', 'K' };
+
+static mapped_file_t packFile;
+static const asset_pack_entry_t* packEntries;
+static uint32_t numPackEntries;
+static uint64_t packSize;
+static int64_t packMtime;
+
+/*
+ * Function: openAssetPack
+ * -------------------
+ * Maps the pack file and validates its header and every entry, so lookups
+ * afterwards can trust the offsets and sizes
+ * 
+ * const char* packPath: Pack file path
+ * 
+ * returns: true/false if there is a usable pack
+ */
+bool openAssetPack(const char* packPath) {
+    closeAssetPack();
+    if (!getFileInfo(packPath, &packSize, &packMtime) || !mapFile(packPath, &packFile))
+        return false;
+
+    const asset_pack_header_t* header = (const asset_pack_header_t*)packFile.data;
+    if (packFile.size < sizeof(*header)
+        || memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(header->magic)) != 0
+        || header->version != ASSET_PACK_VERSION
+        || header->numAssets > (packFile.size - sizeof(*header)) / sizeof(asset_pack_entry_t)) {
+        fprintf(stderr, "Invalid asset pack %s\n", packPath);
+        closeAssetPack();
+        return false;
+    }
+
+    const asset_pack_entry_t* entries = (const asset_pack_entry_t*)(packFile.data + sizeof(*header));
+    for (uint32_t i = 0; i < header->numAssets; i++) {
+        if (memchr(entries[i].name, '\0', ASSET_PACK_NAME_LENGTH) == NULL
+            || entries[i].offset % ASSET_PACK_ALIGNMENT != 0
+            || entries[i].offset > packFile.size
+            || entries[i].size > packFile.size - entries[i].offset
+            || (i > 0 && strcmp(entries[i - 1].name, entries[i].name) >= 0)) {
+            fprintf(stderr, "Invalid asset pack %s\n", packPath);
+            closeAssetPack();
+            return false;
+        }
+    }
+
+    packEntries = entries;
+    numPackEntries = header->numAssets;
+    return true;
+}
+
+bool isAssetPackOpen(void) {
+    return packEntries != NULL;
+}
+
+int getNumAssets(void) {
+    return (int)numPackEntries;
+}
+
+/*
+ * Function: findAsset
+ * -------------------
+ * Looks an asset up by name with a binary search of the sorted entries
+ * 
+ * const char* name: Path relative to the assets directory, e.g. "barrel.png"
+ * 
+ * returns: int Asset id, -1 if the pack has no such asset
+ */
+int findAsset(const char* name) {
+    int low = 0, high = (int)numPackEntries - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int order = strcmp(name, packEntries[middle].name);
+        if (order == 0)
+            return middle;
+        if (order < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
+    }
+    return -1;
+}
+
+const char* getAssetName(int id) {
+    if (id < 0 || id >= (int)numPackEntries)
+        return NULL;
+    return packEntries[id].name;
+}
+
+asset_type_t getAssetType(int id) {
+    if (id < 0 || id >= (int)numPackEntries)
+        return ASSET_RAW;
+    return (asset_type_t)packEntries[id].type;
+}
+
+/*
+ * Function: getAssetData
+ * -------------------
+ * Returns the bytes of an asset, inside the mapped pack
+ * 
+ * int id: Asset id
+ * size_t* size: Receives the size in bytes
+ * 
+ * returns: const unsigned char* Asset data, valid until closeAssetPack(), NULL for a bad id
+ */
+const unsigned char* getAssetData(int id, size_t* size) {
+    if (id < 0 || id >= (int)numPackEntries)
+        return NULL;
+    *size = (size_t)packEntries[id].size;
+    return packFile.data + packEntries[id].offset;
+}
+
+/*
+ * Function: getAssetPackInfo
+ * -------------------
+ * Returns the size and modification time the open pack had when mapped
+ * 
+ * uint64_t* size: Receives the size in bytes
+ * int64_t* mtime: Receives the modification time
+ * 
+ * returns: true/false if a pack is open
+ */
+bool getAssetPackInfo(uint64_t* size, int64_t* mtime) {
+    if (!isAssetPackOpen())
+        return false;
+    *size = packSize;
+    *mtime = packMtime;
+    return true;
+}
+
+static int compareItemNames(const void* a, const void* b) {
+    return strcmp((*(const asset_pack_item_t* const*)a)->name, (*(const asset_pack_item_t* const*)b)->name);
+}
+
+/*
+ * Function: writeAssetPack
+ * -------------------
+ * Writes a pack holding the given assets. Like the texture cache it is
+ * written to a temporary file first and renamed over the old pack once
+ * complete.
+ * 
+ * const char* packPath: Pack file path
+ * const asset_pack_item_t* items: Assets, names must be unique
+ * int numItems: Number of assets
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool writeAssetPack(const char* packPath, const asset_pack_item_t* items, int numItems) {
+    static const unsigned char zeros[ASSET_PACK_ALIGNMENT] = { 0 };
+    char tmpPath[1024];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", packPath);
+
+    const asset_pack_item_t** sorted = malloc(sizeof(*sorted) * (numItems > 0 ? numItems : 1));
+    if (sorted == NULL)
+        return false;
+    for (int i = 0; i < numItems; i++) {
+        if (strlen(items[i].name) >= ASSET_PACK_NAME_LENGTH) {
+            fprintf(stderr, "Asset name too long: %s\n", items[i].name);
+            free(sorted);
+            return false;
+        }
+        sorted[i] = &items[i];
+    }
+    qsort(sorted, numItems, sizeof(*sorted), compareItemNames);
+    for (int i = 1; i < numItems; i++) {
+        if (strcmp(sorted[i - 1]->name, sorted[i]->name) == 0) {
+            fprintf(stderr, "Duplicated asset name: %s\n", sorted[i]->name);
+            free(sorted);
+            return false;
+        }
+    }
+
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating asset pack %s\n", tmpPath);
+        free(sorted);
+        return false;
+    }
+
+    asset_pack_header_t header = { .version = ASSET_PACK_VERSION, .numAssets = numItems };
+    memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // Entry table, with the data of every asset placed on the next aligned offset
+    uint64_t offset = sizeof(header) + (uint64_t)numItems * sizeof(asset_pack_entry_t);
+    for (int i = 0; i < numItems && ok; i++) {
+        asset_pack_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.name, sorted[i]->name, ASSET_PACK_NAME_LENGTH - 1);
+        entry.type = sorted[i]->type;
+        offset += (ASSET_PACK_ALIGNMENT - offset % ASSET_PACK_ALIGNMENT) % ASSET_PACK_ALIGNMENT;
+        entry.offset = offset;
+        entry.size = sorted[i]->size;
+        offset += entry.size;
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+
+    uint64_t position = sizeof(header) + (uint64_t)numItems * sizeof(asset_pack_entry_t);
+    for (int i = 0; i < numItems && ok; i++) {
+        size_t padding = (ASSET_PACK_ALIGNMENT - position % ASSET_PACK_ALIGNMENT) % ASSET_PACK_ALIGNMENT;
+        ok = fwrite(zeros, 1, padding, file) == padding
+            && fwrite(sorted[i]->data, 1, sorted[i]->size, file) == sorted[i]->size;
+        position += padding + sorted[i]->size;
+    }
+    free(sorted);
+
+    ok = fclose(file) == 0 && ok;
+    remove(packPath);
+    if (!ok || rename(tmpPath, packPath) != 0) {
+        fprintf(stderr, "Error writing asset pack %s\n", packPath);
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Function: closeAssetPack
+ * -------------------
+ * Unmaps the pack. Data returned by getAssetData() is invalid afterwards.
+ * 
+ * returns: void
+ */
+void closeAssetPack(void) {
+    unmapFile(&packFile);
+    packEntries = NULL;
+    numPackEntries = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ASSET_PACK_FILE "./assets/assets.pack"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_NAME_LENGTH 64
+#define ASSET_PACK_ALIGNMENT 64
+
+typedef enum {
+    ASSET_RAW,
+    ASSET_IMAGE,    // PNG file: wall textures and sprite sheets
+    ASSET_MAP       // Map grid
+} asset_type_t;
+
+// Asset handed to writeAssetPack()
+typedef struct {
+    const char* name;
+    asset_type_t type;
+    const void* data;
+    size_t size;
+} asset_pack_item_t;
+
+bool openAssetPack(const char* packPath);
+bool isAssetPackOpen(void);
+int getNumAssets(void);
+int findAsset(const char* name);
+const char* getAssetName(int id);
+asset_type_t getAssetType(int id);
+const unsigned char* getAssetData(int id, size_t* size);
+bool getAssetPackInfo(uint64_t* size, int64_t* mtime);
+bool writeAssetPack(const char* packPath, const asset_pack_item_t* items, int numItems);
+void closeAssetPack(void);
+
+#endif
@@ -4,18 +4,67 @@
 #include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "app.h"
 #include "display.h"
 #include "map.h"
-#include "player.h"
+#include "palette.h"
 #include "ray.h"
+#include "render.h"
 #include "sprite.h"
 #include "textures.h"
 
 static SDL_Window* window;
 static SDL_Renderer* renderer;
-static uint32_t* color_buffer;
 static SDL_Texture* color_buffer_texture;
+static bool headless;               // Frames stay in the main context color buffer, no SDL window
+
+// Cache slot of a minimap chunk. Chunk (row, col) can only live in slot
+// (row % MINIMAP_CACHE_ROWS, col % MINIMAP_CACHE_COLS): the chunks in view
+// never share a slot, and scrolling only redraws the chunks that come in.
+typedef struct {
+    int row, col;       // Chunk held by the slot, in chunks; -1 if empty
+    bool has_indices;   // Palette indices built
+} minimap_chunk_t;
+
+static struct {
+    minimap_chunk_t chunks[MINIMAP_CACHE_ROWS * MINIMAP_CACHE_COLS];
+    uint32_t* colors;   // Texels of every slot, MINIMAP_CHUNK_WIDTH x MINIMAP_CHUNK_HEIGHT each
+    uint8_t* indices;   // Palette indices of colors, allocated on first palettized use
+    SDL_SpinLock lock;  // Held while a context draws its minimap
+} minimap;
+
+// Polygon edge for the scanline fill, top to bottom
+typedef struct {
+    int first_row;      // First row whose center is inside the edge
+    int end_row;        // Row after the last one
+    float x0, y0;       // Top vertex
+    float step;         // x change per row
+    float x;            // Intersection with the center of the current row
+} polygon_edge_t;
+
+/*
+ * Function: initializeRenderTarget
+ * -------------------
+ * Sets up the main render context and loads the assets, for both the
+ * window and the headless mode
+ * 
+ * uint32_t* target: WINDOW_WIDTH x WINDOW_HEIGHT pixels to render into, or NULL to allocate them
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool initializeRenderTarget(uint32_t* target) {
+    if (!initRenderContext(getMainRenderContext(), target, WINDOW_WIDTH, WINDOW_HEIGHT))
+        return false;
+
+    // Load textures and sprites
+    loadTextures();
+    loadSprites();
+
+    return true;
+}
 
 /*
  * Function: initializeWindow
@@ -47,9 +96,6 @@ bool initializeWindow() {
         return false;
     }
     
-    // Allocate the required memory in bytes to hold the color buffer
-    color_buffer = (uint32_t*) malloc(sizeof(uint32_t) * WINDOW_WIDTH * WINDOW_HEIGHT);
-    
     // Creating a SDL texture that is used to display the color buffer
     color_buffer_texture = SDL_CreateTexture(
         renderer,
@@ -59,11 +105,23 @@ bool initializeWindow() {
         WINDOW_HEIGHT
     );
 
-    // Load textures and sprites
-    loadTextures();
-    loadSprites();
+    return initializeRenderTarget(NULL);
+}
 
-    return true;
+/*
+ * Function: initializeHeadless
+ * -------------------
+ * Sets up rendering without a window: frames are drawn the same way and
+ * left in memory, for servers, benchmarks and batch jobs. SDL is not
+ * initialized; only its thread functions are used, by the texture loader.
+ * 
+ * uint32_t* target: WINDOW_WIDTH x WINDOW_HEIGHT pixels owned by the caller, or NULL to allocate them
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool initializeHeadless(uint32_t* target) {
+    headless = true;
+    return initializeRenderTarget(target);
 }
 
 /*
@@ -75,27 +133,93 @@ bool initializeWindow() {
  */
 void destroyResources() {
     freeTextures();
-    free(color_buffer);
+    freeSprites();
+    freeRenderContext(getMainRenderContext());
+    free(minimap.colors);
+    free(minimap.indices);
+    if (headless)
+        return;
     SDL_DestroyTexture(color_buffer_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
+/*
+ * Function: getColorBuffer
+ * -------------------
+ * Gives direct access to the color buffer for passes that clip their
+ * geometry up front and can skip the per-pixel checks of draw_pixel()
+ * 
+ * returns: uint32_t* WINDOW_WIDTH x WINDOW_HEIGHT color buffer
+ */
+uint32_t* getColorBuffer() {
+    return getMainRenderContext()->colorBuffer;
+}
+
+/*
+ * Function: getIndexBuffer
+ * -------------------
+ * Gives direct access to the 8-bit framebuffer used in palettized mode
+ * 
+ * returns: uint8_t* WINDOW_WIDTH x WINDOW_HEIGHT palette indices
+ */
+uint8_t* getIndexBuffer() {
+    return getMainRenderContext()->indexBuffer;
+}
+
+/*
+ * Function: fillSpan
+ * -------------------
+ * Sets a run of 32-bit pixels to one color, 16 bytes per store where SSE2
+ * is available
+ * 
+ * uint32_t* pixels: First pixel
+ * int count: Number of pixels
+ * uint32_t color: Color
+ * 
+ * returns: void
+ */
+static void fillSpan(uint32_t* pixels, int count, uint32_t color) {
+#ifdef __SSE2__
+    __m128i colors = _mm_set1_epi32((int)color);
+    for (; count >= 8; count -= 8, pixels += 8) {
+        _mm_storeu_si128((__m128i*)pixels, colors);
+        _mm_storeu_si128((__m128i*)(pixels + 4), colors);
+    }
+#endif
+    for (; count > 0; count--)
+        *pixels++ = color;
+}
+
 void clearBuffer() {
-    for (int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++)
-        color_buffer[i] = 0x00000000;
+    clearView(getMainRenderContext());
+}
+
+void clearView(render_context_t* context) {
+    if (isPalettizedMode()) {
+        memset(context->indexBuffer, getPaletteIndex(0xFF000000), context->width * context->height);
+        return;
+    }
+    fillSpan(context->colorBuffer, context->width * context->height, 0x00000000);
 }
 
 /*
  * Function: swapBuffer
  * -------------------
- * We use an intermediate array buffer (color_buffer) to render things on the screen.
- * This function does the clearing up, swapping and rendering with SDL
+ * We use an intermediate array buffer (the color buffer of the main render
+ * context) to render things on the screen. This function does the clearing
+ * up, swapping and rendering with SDL. In headless mode the frame is
+ * complete in the color buffer once this returns.
  * 
  * returns: void
  */
 void swapBuffer() {
+    uint32_t* color_buffer = getMainRenderContext()->colorBuffer;
+    resolveView(getMainRenderContext());
+    if (headless)
+        return;
+
     // Render Color Buffer: Move bits from color_buffer to SDL color_buffer_texture
     SDL_UpdateTexture(color_buffer_texture, NULL, color_buffer, (int)(WINDOW_WIDTH * sizeof(uint32_t)));
     SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
@@ -104,6 +228,107 @@ void swapBuffer() {
     SDL_RenderPresent(renderer);
 }
 
+/*
+ * Function: resolveView
+ * -------------------
+ * Completes the frame of a context in its color buffer. In palettized mode
+ * the 8-bit buffer is expanded through the palette here, the only place
+ * where its pixels become 32-bit.
+ * 
+ * render_context_t* context: Context
+ * 
+ * returns: void
+ */
+void resolveView(render_context_t* context) {
+    if (isPalettizedMode()) {
+        const uint32_t* palette = getPalette();
+        for (int i = 0; i < context->width * context->height; i++)
+            context->colorBuffer[i] = palette[context->indexBuffer[i]];
+    }
+}
+
+/*
+ * Function: saveFramePPM
+ * -------------------
+ * Writes the last presented frame as a binary PPM image
+ * 
+ * const char* path: Output file
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool saveFramePPM(const char* path) {
+    return saveViewPPM(getMainRenderContext(), path);
+}
+
+/*
+ * Function: saveViewPPM
+ * -------------------
+ * Writes the last frame of a context as a binary PPM image
+ * 
+ * const render_context_t* context: Context, with its frame resolved
+ * const char* path: Output file
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool saveViewPPM(const render_context_t* context, const char* path) {
+    uint8_t row[WINDOW_WIDTH * 3];
+    size_t rowSize = context->width * 3;
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating %s\n", path);
+        return false;
+    }
+
+    // Pixels are SDL_PIXELFORMAT_ABGR8888: red in the low byte
+    bool ok = fprintf(file, "P6\n%d %d\n255\n", context->width, context->height) > 0;
+    for (int y = 0; y < context->height && ok; y++) {
+        const uint32_t* pixels = context->colorBuffer + (context->width * y);
+        for (int x = 0; x < context->width; x++) {
+            row[(x * 3)] = pixels[x] & 0xFF;
+            row[(x * 3) + 1] = (pixels[x] >> 8) & 0xFF;
+            row[(x * 3) + 2] = (pixels[x] >> 16) & 0xFF;
+        }
+        ok = fwrite(row, 1, rowSize, file) == rowSize;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Error writing %s\n", path);
+    return ok;
+}
+
+/*
+ * Function: fillRect
+ * -------------------
+ * Fills a rectangle in the frame of a context. The rectangle is clipped
+ * against the window once, then filled one row span at a time.
+ * 
+ * render_context_t* context: Context
+ * int left, top: Top left corner
+ * int width, height: Rectangle size in pixels
+ * uint32_t color: Color to fill the rectangle
+ * 
+ * returns: void
+ */
+static void fillRect(render_context_t* context, int left, int top, int width, int height, uint32_t color) {
+    int right = left + width;
+    int bottom = top + height;
+    left = left < 0 ? 0 : left;
+    top = top < 0 ? 0 : top;
+    right = right > WINDOW_WIDTH ? WINDOW_WIDTH : right;
+    bottom = bottom > WINDOW_HEIGHT ? WINDOW_HEIGHT : bottom;
+    if (left >= right || top >= bottom)
+        return;
+
+    if (isPalettizedMode()) {
+        uint8_t index = getPaletteIndex(color);
+        for (int y = top; y < bottom; y++)
+            memset(context->indexBuffer + (WINDOW_WIDTH * y) + left, index, right - left);
+        return;
+    }
+    for (int y = top; y < bottom; y++)
+        fillSpan(context->colorBuffer + (WINDOW_WIDTH * y) + left, right - left, color);
+}
+
 /*
  * Function: draw_rect
  * -------------------
@@ -126,15 +351,24 @@ void swapBuffer() {
  * returns: void
  */
 void draw_rect(int x, int y, int width, int height, uint32_t color) {
-    for (int i = -width/2.0; i < width/2.0; i++) {
-        for (int j = -height/2.0; j < height/2.0; j++) {
-            int current_x = x + i;
-            int current_y = y + j;
-            if (current_x >= 0 && current_x < WINDOW_WIDTH && current_y >= 0 && current_y < WINDOW_HEIGHT) {
-                color_buffer[(WINDOW_WIDTH * current_y) + current_x] = color;
-            }
-        }
-    }
+    drawViewRect(getMainRenderContext(), x, y, width, height, color);
+}
+
+/*
+ * Function: drawViewRect
+ * -------------------
+ * Draw a rectangle like draw_rect() in the frame of a context
+ * 
+ * render_context_t* context: Context
+ * int x, y: Center of the rectangle
+ * int width, height: Rectangle size in pixels
+ * uint32_t color: Color to fill the rectangle
+ * 
+ * returns: void
+ */
+void drawViewRect(render_context_t* context, int x, int y, int width, int height, uint32_t color) {
+    // An odd size puts the extra pixel after the center
+    fillRect(context, x - width / 2, y - height / 2, width, height, color);
 }
 
 /*
@@ -150,14 +384,68 @@ void draw_rect(int x, int y, int width, int height, uint32_t color) {
  */
 void draw_pixel(int x, int y, uint32_t color) {
     if (x >= 0 && x < WINDOW_WIDTH && y >= 0 && y < WINDOW_HEIGHT) {
-        color_buffer[(WINDOW_WIDTH * y) + x] = color;
+        if (isPalettizedMode())
+            getMainRenderContext()->indexBuffer[(WINDOW_WIDTH * y) + x] = getPaletteIndex(color);
+        else
+            getMainRenderContext()->colorBuffer[(WINDOW_WIDTH * y) + x] = color;
+    }
+}
+
+/*
+ * Function: clipLineSteps
+ * -------------------
+ * Clips the steps of a Bresenham line to the window. Step k of the line
+ * is at major + k * majorDir on the major axis and at
+ * minor + floor((2 * k * minorDelta + majorDelta) / (2 * majorDelta)) *
+ * minorDir on the minor one; both are monotonic in k, so the steps inside
+ * the window are one interval, solved for exactly in integers. The pixels
+ * drawn are the same as stepping the whole line and checking every one.
+ * 
+ * int major, minor: Start point on the major and minor axes
+ * int majorDir, minorDir: -1 or 1
+ * int64_t majorDelta, minorDelta: Line length on each axis, majorDelta > 0
+ * int majorSize, minorSize: Window size on each axis
+ * int64_t* first: Receives the first step inside the window
+ * int64_t* last: Receives the last step inside the window
+ * 
+ * returns: true/false if any step is inside the window
+ */
+static bool clipLineSteps(int major, int minor, int majorDir, int minorDir, int64_t majorDelta, int64_t minorDelta,
+                          int majorSize, int minorSize, int64_t* first, int64_t* last) {
+    *first = 0;
+    *last = majorDelta;
+
+    // Major axis: 0 <= major + k * majorDir < majorSize
+    int64_t low = majorDir > 0 ? -(int64_t)major : (int64_t)major - (majorSize - 1);
+    int64_t high = majorDir > 0 ? (int64_t)majorSize - 1 - major : (int64_t)major;
+    *first = low > *first ? low : *first;
+    *last = high < *last ? high : *last;
+
+    // Minor axis: the offset f(k) from minor must stay within [low, high]
+    low = minorDir > 0 ? -(int64_t)minor : (int64_t)minor - (minorSize - 1);
+    high = minorDir > 0 ? (int64_t)minorSize - 1 - minor : (int64_t)minor;
+    if (high < 0 || (minorDelta == 0 && low > 0))
+        return false;
+    if (minorDelta > 0) {
+        // f(k) >= low  <=>  k >= ceil((2 * low - 1) * majorDelta / (2 * minorDelta))
+        if (low > 0) {
+            int64_t num = (2 * low - 1) * majorDelta, den = 2 * minorDelta;
+            int64_t k = (num + den - 1) / den;
+            *first = k > *first ? k : *first;
+        }
+        // f(k) <= high  <=>  k <= ceil((2 * high + 1) * majorDelta / (2 * minorDelta)) - 1
+        int64_t num = (2 * high + 1) * majorDelta, den = 2 * minorDelta;
+        int64_t k = (num + den - 1) / den - 1;
+        *last = k < *last ? k : *last;
     }
+    return *first <= *last;
 }
 
 /*
  * Function: draw_line
  * -------------------
- * Draw a line on the screen 
+ * Draw a line on the screen with the integer Bresenham algorithm. The line
+ * is clipped to the window once, so the pixels are written unchecked.
  * 
  * (x0, y0) x==========x (x1, y1)
  * 
@@ -170,71 +458,372 @@ void draw_pixel(int x, int y, uint32_t color) {
  * returns: void
  */
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
-    int delta_x = (x1 - x0);
-    int delta_y = (y1 - y0);
+    int64_t delta_x = (int64_t)x1 - x0;
+    int64_t delta_y = (int64_t)y1 - y0;
+    int dir_x = delta_x < 0 ? -1 : 1;
+    int dir_y = delta_y < 0 ? -1 : 1;
+    delta_x *= dir_x;
+    delta_y *= dir_y;
+
+    if (delta_x == 0 && delta_y == 0) {
+        draw_pixel(x0, y0, color);
+        return;
+    }
+
+    // Walk the longest side one pixel at a time, the other one when the error overflows
+    bool x_major = delta_x >= delta_y;
+    int64_t major_delta = x_major ? delta_x : delta_y;
+    int64_t minor_delta = x_major ? delta_y : delta_x;
+    int64_t first, last;
+    bool visible = x_major
+        ? clipLineSteps(x0, y0, dir_x, dir_y, major_delta, minor_delta, WINDOW_WIDTH, WINDOW_HEIGHT, &first, &last)
+        : clipLineSteps(y0, x0, dir_y, dir_x, major_delta, minor_delta, WINDOW_HEIGHT, WINDOW_WIDTH, &first, &last);
+    if (!visible)
+        return;
+
+    // Jump straight to the first visible step: error = (2 * k * minor + major) mod (2 * major)
+    int64_t numerator = 2 * first * minor_delta + major_delta;
+    int64_t minor_offset = numerator / (2 * major_delta);
+    int64_t error = numerator % (2 * major_delta);
+    int x = x_major ? x0 + first * dir_x : x0 + minor_offset * dir_x;
+    int y = x_major ? y0 + minor_offset * dir_y : y0 + first * dir_y;
+
+    int offset = (WINDOW_WIDTH * y) + x;
+    int major_step = x_major ? dir_x : dir_y * WINDOW_WIDTH;
+    int minor_step = x_major ? dir_y * WINDOW_WIDTH : dir_x;
+    int count = (int)(last - first) + 1;
+    int64_t error_step = 2 * minor_delta;
+    int64_t error_limit = 2 * major_delta;
+    int64_t current_error = error;
+
+    if (isPalettizedMode()) {
+        uint8_t* index_buffer = getMainRenderContext()->indexBuffer;
+        uint8_t index = getPaletteIndex(color);
+        for (int i = 0; i < count; i++) {
+            index_buffer[offset] = index;
+            offset += major_step;
+            current_error += error_step;
+            if (current_error >= error_limit) {
+                current_error -= error_limit;
+                offset += minor_step;
+            }
+        }
+    } else {
+        uint32_t* color_buffer = getMainRenderContext()->colorBuffer;
+        for (int i = 0; i < count; i++) {
+            color_buffer[offset] = color;
+            offset += major_step;
+            current_error += error_step;
+            if (current_error >= error_limit) {
+                current_error -= error_limit;
+                offset += minor_step;
+            }
+        }
+    }
+}
+
+static int comparePolygonEdges(const void* a, const void* b) {
+    return ((const polygon_edge_t*)a)->first_row - ((const polygon_edge_t*)b)->first_row;
+}
+
+/*
+ * Function: fillPolygon
+ * -------------------
+ * Fills a polygon in the frame of a context with a scanline sweep: the
+ * edges are sorted by their first row, and every row fills the spans
+ * between pairs of the active edges (even-odd rule). A pixel is filled
+ * when its center is inside, so polygons sharing an edge don't overlap.
+ * 
+ * render_context_t* context: Context
+ * const float* x: Horizontal pixel coordinates of the vertices
+ * const float* y: Vertical pixel coordinates of the vertices
+ * int numVertices: Number of vertices, up to MAX_POLYGON_VERTICES
+ * uint32_t color: Color to fill the polygon
+ * 
+ * returns: void
+ */
+static void fillPolygon(render_context_t* context, const float* x, const float* y, int numVertices, uint32_t color) {
+    polygon_edge_t polygon_edges[MAX_POLYGON_VERTICES];
+    int polygon_active[MAX_POLYGON_VERTICES];
+    if (numVertices < 3 || numVertices > MAX_POLYGON_VERTICES)
+        return;
+
+    int numEdges = 0;
+    for (int i = 0; i < numVertices; i++) {
+        int next = (i + 1) % numVertices;
+        bool down = y[i] < y[next];
+        float x0 = down ? x[i] : x[next], y0 = down ? y[i] : y[next];
+        float x1 = down ? x[next] : x[i], y1 = down ? y[next] : y[i];
+        polygon_edge_t* edge = &polygon_edges[numEdges];
+        edge->first_row = (int)ceilf(y0 - 0.5f);
+        edge->end_row = (int)ceilf(y1 - 0.5f);
+        if (edge->first_row >= edge->end_row || edge->end_row <= 0 || edge->first_row >= WINDOW_HEIGHT)
+            continue;   // Horizontal, or outside the window
+        edge->x0 = x0;
+        edge->y0 = y0;
+        edge->step = (x1 - x0) / (y1 - y0);
+        numEdges++;
+    }
+    qsort(polygon_edges, numEdges, sizeof(polygon_edge_t), comparePolygonEdges);
+
+    bool palettized = isPalettizedMode();
+    uint8_t index = palettized ? getPaletteIndex(color) : 0;
+    int numActive = 0, nextEdge = 0;
+    int row = numEdges > 0 ? polygon_edges[0].first_row : WINDOW_HEIGHT;
+    for (row = row < 0 ? 0 : row; row < WINDOW_HEIGHT && (numActive > 0 || nextEdge < numEdges); row++) {
+        // Drop the edges that ended, then add the ones starting on this row
+        int kept = 0;
+        for (int i = 0; i < numActive; i++) {
+            if (row < polygon_edges[polygon_active[i]].end_row)
+                polygon_active[kept++] = polygon_active[i];
+        }
+        numActive = kept;
+        for (; nextEdge < numEdges && polygon_edges[nextEdge].first_row <= row; nextEdge++) {
+            if (row < polygon_edges[nextEdge].end_row)
+                polygon_active[numActive++] = nextEdge;
+        }
+
+        // Computed from the top vertex rather than stepped, so long edges don't drift
+        float center = row + 0.5f;
+        for (int i = 0; i < numActive; i++) {
+            polygon_edge_t* edge = &polygon_edges[polygon_active[i]];
+            edge->x = edge->x0 + (center - edge->y0) * edge->step;
+        }
+
+        // Insertion sort by x, the order barely changes from one row to the next
+        for (int i = 1; i < numActive; i++) {
+            int current = polygon_active[i], j = i - 1;
+            while (j >= 0 && polygon_edges[polygon_active[j]].x > polygon_edges[current].x) {
+                polygon_active[j + 1] = polygon_active[j];
+                j--;
+            }
+            polygon_active[j + 1] = current;
+        }
+
+        for (int i = 0; i + 1 < numActive; i += 2) {
+            int start = (int)ceilf(polygon_edges[polygon_active[i]].x - 0.5f);
+            int end = (int)ceilf(polygon_edges[polygon_active[i + 1]].x - 0.5f);
+            start = start < 0 ? 0 : start;
+            end = end > WINDOW_WIDTH ? WINDOW_WIDTH : end;
+            if (start >= end)
+                continue;
+            if (palettized)
+                memset(context->indexBuffer + (WINDOW_WIDTH * row) + start, index, end - start);
+            else
+                fillSpan(context->colorBuffer + (WINDOW_WIDTH * row) + start, end - start, color);
+        }
+    }
+}
+
+/*
+ * Function: draw_polygon
+ * -------------------
+ * Fills a polygon on the screen (see fillPolygon())
+ * 
+ * const float* x: Horizontal pixel coordinates of the vertices
+ * const float* y: Vertical pixel coordinates of the vertices
+ * int numVertices: Number of vertices, up to MAX_POLYGON_VERTICES
+ * uint32_t color: Color to fill the polygon
+ * 
+ * returns: void
+ */
+void draw_polygon(const float* x, const float* y, int numVertices, uint32_t color) {
+    fillPolygon(getMainRenderContext(), x, y, numVertices, color);
+}
+
+/*
+ * Function: invalidateMiniMapChunks
+ * -------------------
+ * Empties the minimap chunk cache. Call it whenever the map changes; the
+ * chunks are drawn again as they come into view.
+ * 
+ * returns: void
+ */
+void invalidateMiniMapChunks() {
+    for (int i = 0; i < MINIMAP_CACHE_ROWS * MINIMAP_CACHE_COLS; i++) {
+        minimap.chunks[i].row = -1;
+        minimap.chunks[i].col = -1;
+        minimap.chunks[i].has_indices = false;
+    }
+}
+
+/*
+ * Function: worldToMiniMap
+ * -------------------
+ * Converts a map position to the screen while the minimap of a context
+ * is drawn
+ * 
+ * const render_context_t* context: Context, with its minimap view placed
+ * float x, y: Map coordinates
+ * float* minimapX, minimapY: Screen coordinates in the minimap view
+ * 
+ * returns: void
+ */
+void worldToMiniMap(const render_context_t* context, float x, float y, float* minimapX, float* minimapY) {
+    *minimapX = x * ((float)MINIMAP_WIDTH_TILE_SIZE / TILE_SIZE) - context->minimapX;
+    *minimapY = y * ((float)MINIMAP_HEIGHT_TILE_SIZE / TILE_SIZE) - context->minimapY;
+}
 
-    int longest_side_length = (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
+/*
+ * Function: drawMiniMapChunk
+ * -------------------
+ * Draws the tiles of a chunk into a cache slot
+ * 
+ * int slot: Cache slot
+ * int row, col: Chunk position, in chunks
+ * 
+ * returns: void
+ */
+static void drawMiniMapChunk(int slot, int row, int col) {
+    uint32_t* pixels = minimap.colors + (size_t)slot * MINIMAP_CHUNK_WIDTH * MINIMAP_CHUNK_HEIGHT;
+    for (int i = 0; i < MINIMAP_CHUNK_TILES; i++) {
+        int tileRow = row * MINIMAP_CHUNK_TILES + i;
+        for (int j = 0; j < MINIMAP_CHUNK_TILES; j++) {
+            int tileCol = col * MINIMAP_CHUNK_TILES + j;
+            // Tiles past the map edge are never copied to the screen
+            uint32_t tileColor = tileRow < MAP_NUM_ROWS && tileCol < MAP_NUM_COLS ? getMapTileColor(tileRow, tileCol) : 0;
+            uint32_t* tile = pixels + (i * MINIMAP_HEIGHT_TILE_SIZE * MINIMAP_CHUNK_WIDTH) + (j * MINIMAP_WIDTH_TILE_SIZE);
+            for (int y = 0; y < MINIMAP_HEIGHT_TILE_SIZE; y++)
+                fillSpan(tile + (y * MINIMAP_CHUNK_WIDTH), MINIMAP_WIDTH_TILE_SIZE, tileColor);
+        }
+    }
 
-    float x_inc = delta_x / (float)longest_side_length;
-    float y_inc = delta_y / (float)longest_side_length;
+    minimap.chunks[slot].row = row;
+    minimap.chunks[slot].col = col;
+    minimap.chunks[slot].has_indices = false;
+}
 
-    float current_x = x0;
-    float current_y = y0;
+/*
+ * Function: blitMiniMapChunks
+ * -------------------
+ * Copies the part of the map in the minimap view of a context into its
+ * frame, one chunk row at a time. Chunks missing from the cache are drawn
+ * first. The cost follows the size of the view, not of the map. The
+ * cache is shared by every context: the caller holds minimap.lock.
+ * 
+ * render_context_t* context: Context, with its minimap view placed
+ * 
+ * returns: void
+ */
+static void blitMiniMapChunks(render_context_t* context) {
+    const int chunkSize = MINIMAP_CHUNK_WIDTH * MINIMAP_CHUNK_HEIGHT;
+    bool palettized = isPalettizedMode();
+    if (minimap.colors == NULL) {
+        minimap.colors = (uint32_t*) malloc(sizeof(uint32_t) * MINIMAP_CACHE_ROWS * MINIMAP_CACHE_COLS * chunkSize);
+        if (minimap.colors == NULL)
+            return;
+        invalidateMiniMapChunks();
+    }
+    if (palettized && minimap.indices == NULL) {
+        minimap.indices = (uint8_t*) malloc((size_t)MINIMAP_CACHE_ROWS * MINIMAP_CACHE_COLS * chunkSize);
+        if (minimap.indices == NULL)
+            return;
+    }
 
-    for (int i = 0; i <= longest_side_length; i++) {
-        draw_pixel(round(current_x), round(current_y), color);
-        current_x += x_inc;
-        current_y += y_inc;
+    // Part of the map in view, in whole minimap pixels
+    int left = context->minimapX;
+    int top = context->minimapY;
+    int right = left + WINDOW_WIDTH < MINIMAP_WIDTH ? left + WINDOW_WIDTH : MINIMAP_WIDTH;
+    int bottom = top + WINDOW_HEIGHT < MINIMAP_HEIGHT ? top + WINDOW_HEIGHT : MINIMAP_HEIGHT;
+
+    for (int row = top / MINIMAP_CHUNK_HEIGHT; row * MINIMAP_CHUNK_HEIGHT < bottom; row++) {
+        for (int col = left / MINIMAP_CHUNK_WIDTH; col * MINIMAP_CHUNK_WIDTH < right; col++) {
+            int slot = ((row % MINIMAP_CACHE_ROWS) * MINIMAP_CACHE_COLS) + (col % MINIMAP_CACHE_COLS);
+            minimap_chunk_t* chunk = &minimap.chunks[slot];
+            if (chunk->row != row || chunk->col != col)
+                drawMiniMapChunk(slot, row, col);
+
+            uint32_t* colors = minimap.colors + (size_t)slot * chunkSize;
+            uint8_t* indices = palettized ? minimap.indices + (size_t)slot * chunkSize : NULL;
+            if (palettized && !chunk->has_indices) {
+                for (int i = 0; i < chunkSize; i++)
+                    indices[i] = getPaletteIndex(colors[i]);
+                chunk->has_indices = true;
+            }
+
+            // Part of the chunk in view
+            int chunkLeft = col * MINIMAP_CHUNK_WIDTH;
+            int chunkTop = row * MINIMAP_CHUNK_HEIGHT;
+            int x0 = chunkLeft > left ? chunkLeft : left;
+            int x1 = chunkLeft + MINIMAP_CHUNK_WIDTH < right ? chunkLeft + MINIMAP_CHUNK_WIDTH : right;
+            int y0 = chunkTop > top ? chunkTop : top;
+            int y1 = chunkTop + MINIMAP_CHUNK_HEIGHT < bottom ? chunkTop + MINIMAP_CHUNK_HEIGHT : bottom;
+
+            for (int y = y0; y < y1; y++) {
+                int source = ((y - chunkTop) * MINIMAP_CHUNK_WIDTH) + (x0 - chunkLeft);
+                int target = (WINDOW_WIDTH * (y - top)) + (x0 - left);
+                if (palettized)
+                    memcpy(context->indexBuffer + target, indices + source, x1 - x0);
+                else
+                    memcpy(context->colorBuffer + target, colors + source, (x1 - x0) * sizeof(uint32_t));
+            }
+        }
     }
 }
 
 /*
  * Function: draw_mini_map
  * -------------------
- * Draws the minimap
+ * Draws the minimap of the main render context
  * 
  * returns: void
  */
 void draw_mini_map() {
+    drawMiniMapView(getMainRenderContext());
+}
+
+/*
+ * Function: drawMiniMapView
+ * -------------------
+ * Draws the minimap of a context centered on its camera, scrolling over
+ * maps bigger than the window: the cached map chunks in view, the camera,
+ * the view cone as one polygon through the ray hits, and the sprites
+ * 
+ * render_context_t* context: Context, with its rays cast
+ * 
+ * returns: void
+ */
+void drawMiniMapView(render_context_t* context) {
+    float cone_x[NUM_RAYS + 1];
+    float cone_y[NUM_RAYS + 1];
+
+    // View centered on the camera, kept inside the map. A camera off the
+    // map only gets the map and the sprites drawn.
+    bool onMap = isInMap(context->x, context->y);
+    float camera_x = onMap ? context->x * ((float)MINIMAP_WIDTH_TILE_SIZE / TILE_SIZE) : 0;
+    float camera_y = onMap ? context->y * ((float)MINIMAP_HEIGHT_TILE_SIZE / TILE_SIZE) : 0;
+    int view_x = (int)camera_x - WINDOW_WIDTH / 2;
+    int view_y = (int)camera_y - WINDOW_HEIGHT / 2;
+    view_x = view_x < MINIMAP_WIDTH - WINDOW_WIDTH ? view_x : MINIMAP_WIDTH - WINDOW_WIDTH;
+    view_y = view_y < MINIMAP_HEIGHT - WINDOW_HEIGHT ? view_y : MINIMAP_HEIGHT - WINDOW_HEIGHT;
+    context->minimapX = view_x > 0 ? view_x : 0;
+    context->minimapY = view_y > 0 ? view_y : 0;
+
     // Map background
-    for (int i = 0; i < MAP_NUM_ROWS; i++) {
-        for (int j = 0; j < MAP_NUM_COLS; j++) {
-            uint32_t tileColor = getMapTileColor(i, j);
-            float x = (j + 0.5) * MINIMAP_WIDTH_TILE_SIZE;
-            float y = (i + 0.5) * MINIMAP_HEIGHT_TILE_SIZE;
-            draw_rect(
-                x, 
-                y, 
-                MINIMAP_WIDTH_TILE_SIZE, 
-                MINIMAP_HEIGHT_TILE_SIZE, 
-                tileColor
-            );
-        }
-    }
+    SDL_AtomicLock(&minimap.lock);
+    blitMiniMapChunks(context);
+    SDL_AtomicUnlock(&minimap.lock);
 
-    // Player
-    struct Player player = getPlayer();
-    draw_rect(
-        player.minimap_x, 
-        player.minimap_y, 
-        MINIMAP_WIDTH_TILE_SIZE/8,
-        MINIMAP_HEIGHT_TILE_SIZE/8,
-        0xFF0000FF
-    );
-    
-    // Rays
-    for (int i = 0; i < NUM_RAYS; i++) {
-        draw_line(
-            player.minimap_x, 
-            player.minimap_y, 
-            getRayWallHitX(i) * ((float)WINDOW_WIDTH/MAP_WIDTH), 
-            getRayWallHitY(i) * ((float)WINDOW_HEIGHT/MAP_HEIGHT),
-            0xFF00FFFF
+    if (onMap) {
+        // Camera
+        drawViewRect(
+            context,
+            camera_x - context->minimapX, 
+            camera_y - context->minimapY, 
+            MINIMAP_WIDTH_TILE_SIZE/8,
+            MINIMAP_HEIGHT_TILE_SIZE/8,
+            0xFF0000FF
         );
+    
+        // View cone: the camera and every ray hit, in ray order
+        worldToMiniMap(context, context->x, context->y, &cone_x[0], &cone_y[0]);
+        for (int i = 0; i < NUM_RAYS; i++)
+            worldToMiniMap(context, context->rays[i].wallHitX, context->rays[i].wallHitY, &cone_x[i + 1], &cone_y[i + 1]);
+        fillPolygon(context, cone_x, cone_y, NUM_RAYS + 1, 0xFF00FFFF);
     }
 
     // Sprites
-    drawSpritesInMiniMap();
+    drawSpriteViewInMiniMap(context);
 }
 
 /*
@@ -245,41 +834,99 @@ void draw_mini_map() {
  * returns: void
  */
 void drawWallProjection() {
-    struct Player player = getPlayer();
+    render_context_t* context = getMainRenderContext();
     for (int i = 0; i < NUM_RAYS; i++) {
+        int texture = context->rays[i].textureIndex - 1;
+        if (texture >= 0 && texture < NUM_TEXTURES)
+            getTexture(texture);
+    }
+    drawWallView(context);
+}
+
+/*
+ * Function: drawWallView
+ * -------------------
+ * Draws the 3d projection of the map seen by a context. The textures its
+ * rays hit are only peeked: getTexture() has made them resident already.
+ * 
+ * render_context_t* context: Context, with its rays cast
+ * 
+ * returns: void
+ */
+void drawWallView(render_context_t* context) {
+    int width = context->width;
+    int height = context->height;
+    double distProjPlane = DIST_PROJ_PLANE_FOR(width);
+    bool palettized = isPalettizedMode();
+    uint8_t ceilingIndex = palettized ? getPaletteIndex(0xFF777777) : 0;
+    uint8_t floorIndex = palettized ? getPaletteIndex(0xFF444444) : 0;
+
+    for (int i = 0; i < width; i++) {
+        const struct Ray* ray = &context->rays[i];
+        uint32_t* colors = context->colorBuffer + i;
+        uint8_t* indices = context->indexBuffer + i;
+
         // Get perpendicular distance to avoid fish-eye distortion
-        float correctedDistance = getRayWallHitDistance(i) * cos(getRayAngle(i) - player.rotationAngle);
-        float projectedWallHeight = ((float)TILE_SIZE / correctedDistance) * DIST_PROJ_PLANE;
+        float correctedDistance = ray->distance * cos(ray->rayAngle - context->angle);
+        float projectedWallHeight = ((float)TILE_SIZE / correctedDistance) * distProjPlane;
 
-        // Get top and bottom pixels
-        int wallTopPixel = (WINDOW_HEIGHT / 2) - (projectedWallHeight / 2);
-        wallTopPixel = wallTopPixel < 0 ? 0 : wallTopPixel;
-        int wallBottomPixel = (WINDOW_HEIGHT / 2) + (projectedWallHeight / 2);
-        wallBottomPixel = wallBottomPixel > WINDOW_HEIGHT ? WINDOW_HEIGHT : wallBottomPixel;
+        // Get top and bottom pixels, kept inside the column: a camera
+        // against a wall can project it to any height
+        int wallTopPixel = (height / 2) - (projectedWallHeight / 2);
+        wallTopPixel = wallTopPixel < 0 ? 0 : (wallTopPixel > height ? height : wallTopPixel);
+        int wallBottomPixel = (height / 2) + (projectedWallHeight / 2);
+        wallBottomPixel = wallBottomPixel > height ? height : (wallBottomPixel < wallTopPixel ? wallTopPixel : wallBottomPixel);
 
         // Render the ceiling on the color buffer
         for (int j = 0; j < wallTopPixel; j++) {
-            draw_pixel(i, j, 0xFF777777);
+            if (palettized)
+                indices[width * j] = ceilingIndex;
+            else
+                colors[width * j] = 0xFF777777;
         }
         
-        // Render the wall on the color buffer
-        int offsetX = getRayWasHitVertical(i)?(int)getRayWallHitY(i) % TILE_SIZE:(int)getRayWallHitX(i) % TILE_SIZE;
-        int textIndex = getRayHitTexture(i) - 1;
-        int textureWidth = upng_get_width(textures[textIndex]);
-        int textureHeight = upng_get_height(textures[textIndex]);
-        float intensityShadingFactor = (float)(200.0) / getRayWallHitDistance(i);
-        for (int j = wallTopPixel; j < wallBottomPixel; j++) {
-            int topDistance = j + (projectedWallHeight / 2) - (WINDOW_HEIGHT / 2);
-            int offsetY = topDistance * ((float)textureHeight / projectedWallHeight);
-            uint32_t* textureBuffer = (uint32_t*)upng_get_buffer(textures[textIndex]);
-            uint32_t color = textureBuffer[(textureWidth * offsetY) + offsetX];
-            changeColorIntensity(&color, intensityShadingFactor);
-            draw_pixel(i, j, color);
+        // Render the wall on the color buffer. A ray that hit no wall, e.g.
+        // from a camera off the map, leaves only the ceiling and the floor.
+        int textureIndex = ray->textureIndex - 1;
+        if (textureIndex < 0 || textureIndex >= NUM_TEXTURES)
+            wallBottomPixel = wallTopPixel;
+        int offsetX = ray->wasHitVertical ? (int)ray->wallHitY % TILE_SIZE : (int)ray->wallHitX % TILE_SIZE;
+        const texture_t* texture = peekTexture(textureIndex);
+        int textureWidth = texture->width;
+        int textureHeight = texture->height;
+        const uint32_t* textureBuffer = texture->pixels;
+        float intensityShadingFactor = (float)(200.0) / ray->distance;
+        // Texel rows are clamped: at the wall ends, float rounding of small
+        // projections can step one row outside the texture
+        if (palettized && texture->indices != NULL) {
+            // 8-bit texels, shaded through one colormap row for the whole column
+            const uint8_t* shade = getColormap(intensityShadingFactor);
+            for (int j = wallTopPixel; j < wallBottomPixel; j++) {
+                int topDistance = j + (projectedWallHeight / 2) - (height / 2);
+                int offsetY = topDistance * ((float)textureHeight / projectedWallHeight);
+                offsetY = offsetY < 0 ? 0 : (offsetY >= textureHeight ? textureHeight - 1 : offsetY);
+                indices[width * j] = shade[texture->indices[(textureWidth * offsetY) + offsetX]];
+            }
+        } else if (textureBuffer != NULL) {
+            for (int j = wallTopPixel; j < wallBottomPixel; j++) {
+                int topDistance = j + (projectedWallHeight / 2) - (height / 2);
+                int offsetY = topDistance * ((float)textureHeight / projectedWallHeight);
+                offsetY = offsetY < 0 ? 0 : (offsetY >= textureHeight ? textureHeight - 1 : offsetY);
+                uint32_t color = textureBuffer[(textureWidth * offsetY) + offsetX];
+                changeColorIntensity(&color, intensityShadingFactor);
+                if (palettized)
+                    indices[width * j] = getPaletteIndex(color);
+                else
+                    colors[width * j] = color;
+            }
         }
 
         // Render the floor on the color buffer
-        for (int j = wallBottomPixel; j < WINDOW_HEIGHT; j++) {
-            draw_pixel(i, j, 0xFF444444);
+        for (int j = wallBottomPixel; j < height; j++) {
+            if (palettized)
+                indices[width * j] = floorIndex;
+            else
+                colors[width * j] = 0xFF444444;
         }
 
     }
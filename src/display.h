@@ -3,16 +3,43 @@
 
 #include <SDL2/SDL.h>
 #include <stdbool.h>
+#include "app.h"
+
+// Largest polygon draw_polygon() fills: the minimap view cone
+#define MAX_POLYGON_VERTICES (NUM_RAYS + 1)
+
+// The minimap is drawn from square chunks of map tiles, cached as they
+// come into view. The cache holds every chunk the window can overlap.
+#define MINIMAP_CHUNK_TILES 4
+#define MINIMAP_CHUNK_WIDTH (MINIMAP_CHUNK_TILES * MINIMAP_WIDTH_TILE_SIZE)
+#define MINIMAP_CHUNK_HEIGHT (MINIMAP_CHUNK_TILES * MINIMAP_HEIGHT_TILE_SIZE)
+#define MINIMAP_CACHE_COLS (WINDOW_WIDTH / MINIMAP_CHUNK_WIDTH + 2)
+#define MINIMAP_CACHE_ROWS (WINDOW_HEIGHT / MINIMAP_CHUNK_HEIGHT + 2)
+
+struct render_context;
 
 bool initializeWindow();
+bool initializeHeadless(uint32_t* target);
 void destroyResources();
+uint32_t* getColorBuffer();
+uint8_t* getIndexBuffer();
 void clearBuffer();
+void clearView(struct render_context* context);
 void swapBuffer();
+void resolveView(struct render_context* context);
+bool saveFramePPM(const char* path);
+bool saveViewPPM(const struct render_context* context, const char* path);
 void draw_rect(int x, int y, int width, int height, uint32_t color);
+void drawViewRect(struct render_context* context, int x, int y, int width, int height, uint32_t color);
 void draw_pixel(int x, int y, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+void draw_polygon(const float* x, const float* y, int numVertices, uint32_t color);
 void drawWallProjection();
+void drawWallView(struct render_context* context);
 void draw_mini_map();
+void drawMiniMapView(struct render_context* context);
+void invalidateMiniMapChunks();
+void worldToMiniMap(const struct render_context* context, float x, float y, float* minimapX, float* minimapY);
 void changeColorIntensity(uint32_t* color, float factor);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef EMBEDDEDTEXTURES_H
+#define EMBEDDEDTEXTURES_H
+
+#include <stdint.h>
+
+#define EMBEDDED_TEXTURES_FILE "./embedded_textures.c"
+#define EMBEDDED_TEXTURES_ALIGNMENT 64
+
+// Texture decoded at build time by the embed_textures tool. Builds with
+// EMBEDDED_ASSETS link the generated table and read no texture files.
+typedef struct {
+    const char* name;           // File name inside the assets directory, e.g. "barrel.png"
+    int width;
+    int height;
+    const uint32_t* pixels;     // 32-bit texels, row-major, in read-only data
+} embedded_texture_t;
+
+extern const embedded_texture_t embeddedTextures[];
+extern const int numEmbeddedTextures;
+
+#endif
@@ -0,0 +1,242 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "framering.h"
+
+static frame_ring_slot_t* getSlot(const frame_ring_t* ring, uint32_t frame) {
+    unsigned char* slots = (unsigned char*)ring->header + FRAME_RING_HEADER_BYTES;
+    return (frame_ring_slot_t*)(slots + (size_t)(frame % ring->header->numSlots) * ring->header->slotBytes);
+}
+
+/*
+ * Function: createFrameRing
+ * -------------------
+ * Creates the shared memory of a ring and maps it. A ring left over under
+ * the same name is unlinked first; processes still reading it keep their
+ * mapping of the old one.
+ * 
+ * frame_ring_t* ring: Receives the ring
+ * const char* name: Shared memory object name, e.g. FRAME_RING_NAME
+ * int width, height: Frame size in pixels
+ * int numSlots: Frames kept at once
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool createFrameRing(frame_ring_t* ring, const char* name, int width, int height, int numSlots) {
+    memset(ring, 0, sizeof(*ring));
+#if defined(_WIN32)
+    fprintf(stderr, "Frame rings need POSIX shared memory.\n");
+    return false;
+#else
+    size_t slotBytes = (FRAME_RING_SLOT_HEADER_BYTES + sizeof(uint32_t) * width * height + 63) / 64 * 64;
+    size_t size = FRAME_RING_HEADER_BYTES + slotBytes * numSlots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating the frame ring %s\n", name);
+        return false;
+    }
+    void* data = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping the frame ring %s\n", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // The new object is zero filled: no frame published yet
+    ring->header = data;
+    ring->size = size;
+    ring->owner = true;
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->header->version = FRAME_RING_VERSION;
+    ring->header->width = width;
+    ring->header->height = height;
+    ring->header->numSlots = numSlots;
+    ring->header->slotBytes = (int32_t)slotBytes;
+    // Readers check the magic last
+    SDL_MemoryBarrierRelease();
+    ring->header->magic = FRAME_RING_MAGIC;
+    return true;
+#endif
+}
+
+/*
+ * Function: openFrameRing
+ * -------------------
+ * Maps the ring of a running producer, to read its frames
+ * 
+ * frame_ring_t* ring: Receives the ring
+ * const char* name: Shared memory object name
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool openFrameRing(frame_ring_t* ring, const char* name) {
+    memset(ring, 0, sizeof(*ring));
+#if defined(_WIN32)
+    fprintf(stderr, "Frame rings need POSIX shared memory.\n");
+    return false;
+#else
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening the frame ring %s\n", name);
+        return false;
+    }
+    struct stat info;
+    void* data = fstat(fd, &info) == 0 && (size_t)info.st_size >= FRAME_RING_HEADER_BYTES
+        ? mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping the frame ring %s\n", name);
+        return false;
+    }
+
+    ring->header = data;
+    ring->size = info.st_size;
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    frame_ring_header_t* header = ring->header;
+    bool valid = header->magic == FRAME_RING_MAGIC;
+    SDL_MemoryBarrierAcquire();
+    valid = valid && header->version == FRAME_RING_VERSION && header->numSlots > 0
+        && header->slotBytes >= FRAME_RING_SLOT_HEADER_BYTES + (int64_t)sizeof(uint32_t) * header->width * header->height
+        && ring->size >= FRAME_RING_HEADER_BYTES + (size_t)header->slotBytes * header->numSlots;
+    if (!valid) {
+        fprintf(stderr, "%s is not a frame ring\n", name);
+        closeFrameRing(ring);
+        return false;
+    }
+    return true;
+#endif
+}
+
+/*
+ * Function: closeFrameRing
+ * -------------------
+ * Unmaps a ring. The producer also marks it closed and unlinks its name.
+ * 
+ * frame_ring_t* ring: Ring
+ * 
+ * returns: void
+ */
+void closeFrameRing(frame_ring_t* ring) {
+#if !defined(_WIN32)
+    if (ring->header != NULL) {
+        if (ring->owner)
+            SDL_AtomicSet(&ring->header->closed, 1);
+        munmap(ring->header, ring->size);
+        if (ring->owner)
+            shm_unlink(ring->name);
+    }
+#endif
+    memset(ring, 0, sizeof(*ring));
+}
+
+/*
+ * Function: beginFramePublish
+ * -------------------
+ * Claims the slot of the next frame, the oldest one, so the frame can be
+ * drawn straight into shared memory. Readers skip the slot until
+ * endFramePublish().
+ * 
+ * frame_ring_t* ring: Ring created by this process
+ * 
+ * returns: uint32_t* width x height pixels to draw the frame into
+ */
+uint32_t* beginFramePublish(frame_ring_t* ring) {
+    uint32_t frame = SDL_AtomicGet(&ring->header->published);
+    frame_ring_slot_t* slot = getSlot(ring, frame);
+    SDL_AtomicSet(&slot->sequence, (int)(2 * frame + 1));
+    return (uint32_t*)((unsigned char*)slot + FRAME_RING_SLOT_HEADER_BYTES);
+}
+
+/*
+ * Function: endFramePublish
+ * -------------------
+ * Stamps the frame drawn since beginFramePublish() and makes it visible
+ * to readers. Two atomic stores: publishing never waits.
+ * 
+ * frame_ring_t* ring: Ring created by this process
+ * float x, y, angle: Camera pose of the frame
+ * 
+ * returns: void
+ */
+void endFramePublish(frame_ring_t* ring, float x, float y, float angle) {
+    uint32_t frame = SDL_AtomicGet(&ring->header->published);
+    frame_ring_slot_t* slot = getSlot(ring, frame);
+    slot->frameIndex = frame;
+#if !defined(_WIN32)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot->timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+    slot->x = x;
+    slot->y = y;
+    slot->angle = angle;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&slot->sequence, (int)(2 * frame + 2));
+    SDL_AtomicSet(&ring->header->published, (int)(frame + 1));
+}
+
+uint32_t getPublishedFrames(frame_ring_t* ring) {
+    return SDL_AtomicGet(&ring->header->published);
+}
+
+/*
+ * Function: peekFrame
+ * -------------------
+ * Finds a published frame in the ring. Its pixels are read in place; the
+ * producer may overwrite them meanwhile, so check isFrameIntact() once
+ * done with them.
+ * 
+ * frame_ring_t* ring: Ring
+ * uint32_t frame: Frame index
+ * 
+ * returns: const frame_ring_slot_t* Slot of the frame, NULL if it is not published yet or was overwritten
+ */
+const frame_ring_slot_t* peekFrame(frame_ring_t* ring, uint32_t frame) {
+    frame_ring_slot_t* slot = getSlot(ring, frame);
+    if (SDL_AtomicGet(&slot->sequence) != (int)(2 * frame + 2))
+        return NULL;
+    SDL_MemoryBarrierAcquire();
+    return slot;
+}
+
+/*
+ * Function: isFrameIntact
+ * -------------------
+ * Tells if a frame returned by peekFrame() is still in its slot, i.e. all
+ * that was read from it since belongs to that frame
+ * 
+ * const frame_ring_slot_t* slot: Slot returned by peekFrame()
+ * uint32_t frame: Frame index given to peekFrame()
+ * 
+ * returns: true/false if the frame was not overwritten
+ */
+bool isFrameIntact(const frame_ring_slot_t* slot, uint32_t frame) {
+    SDL_MemoryBarrierAcquire();
+    return SDL_AtomicGet((SDL_atomic_t*)&slot->sequence) == (int)(2 * frame + 2);
+}
+
+const uint32_t* getFramePixels(const frame_ring_slot_t* slot) {
+    return (const uint32_t*)((const unsigned char*)slot + FRAME_RING_SLOT_HEADER_BYTES);
+}
+
+void setConsumedFrames(frame_ring_t* ring, uint32_t frames) {
+    SDL_AtomicSet(&ring->header->consumed, (int)frames);
+}
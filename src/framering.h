@@ -0,0 +1,64 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared memory object the game publishes to with --shm
+#define FRAME_RING_NAME "/raycast_frames"
+#define FRAME_RING_SLOTS 8
+#define FRAME_RING_MAGIC 0x474E4952     // "RING"
+#define FRAME_RING_VERSION 1
+
+// Start of the first slot and of the pixels inside a slot, in bytes
+#define FRAME_RING_HEADER_BYTES 64
+#define FRAME_RING_SLOT_HEADER_BYTES 64
+
+// Start of the shared memory. Frame n is published in slot n % numSlots,
+// overwriting the oldest one: the producer never waits for consumers.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t numSlots;
+    int32_t slotBytes;          // Slot header and pixels
+    SDL_atomic_t published;     // Frames published, written by the producer only
+    SDL_atomic_t consumed;      // Frames the consumer is done with, written by the consumer only
+    SDL_atomic_t closed;        // Set once the producer stops publishing
+} frame_ring_header_t;
+
+// Header of a slot, followed by width x height ABGR pixels. Readers check
+// the sequence before and after reading the pixels in place: if it
+// changed, the frame was overwritten meanwhile.
+typedef struct {
+    SDL_atomic_t sequence;      // 2n + 1 while frame n is drawn, 2n + 2 once it is published
+    uint32_t frameIndex;
+    uint64_t timestamp;         // Nanoseconds, monotonic clock shared by local processes
+    float x;                    // Camera pose of the frame
+    float y;
+    float angle;
+} frame_ring_slot_t;
+
+// A process' view of a ring
+typedef struct {
+    frame_ring_header_t* header;
+    size_t size;
+    char name[64];
+    bool owner;                 // Created here: unlinked on close
+} frame_ring_t;
+
+bool createFrameRing(frame_ring_t* ring, const char* name, int width, int height, int numSlots);
+bool openFrameRing(frame_ring_t* ring, const char* name);
+void closeFrameRing(frame_ring_t* ring);
+uint32_t* beginFramePublish(frame_ring_t* ring);
+void endFramePublish(frame_ring_t* ring, float x, float y, float angle);
+uint32_t getPublishedFrames(frame_ring_t* ring);
+const frame_ring_slot_t* peekFrame(frame_ring_t* ring, uint32_t frame);
+bool isFrameIntact(const frame_ring_slot_t* slot, uint32_t frame);
+const uint32_t* getFramePixels(const frame_ring_slot_t* slot);
+void setConsumedFrames(frame_ring_t* ring, uint32_t frames);
+
+#endif
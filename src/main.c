@@ -1,15 +1,32 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <SDL2/SDL.h>
 #include "app.h"
 #include "display.h"
+#include "framering.h"
+#include "palette.h"
 #include "player.h"
 #include "sprite.h"
 #include "ray.h"
+#include "render.h"
+#include "textures.h"
 
 // Global game variable
 struct Game game;
 
+// Command line options
+static struct {
+    int headlessFrames;         // Frames to render without a window, 0 to open one
+    const char* ppmPrefix;      // Frames are saved as <prefix>00000.ppm, ... when set
+    const char* shmName;        // Frames are published to this shared memory ring when set
+} options;
+
+// Shared memory ring the frames are drawn into with --shm
+static frame_ring_t frameRing;
+
 // Read input on every loop
 void readInput() {
     SDL_Event sdl_event;
@@ -32,6 +49,24 @@ void readInput() {
                 setPlayerTurnDirection(PLAYER_TURN_DIRECTION_LEFT);
             if (sdl_event.key.keysym.sym == SDLK_m)
                 game.showMiniMap = !game.showMiniMap;
+            if (sdl_event.key.keysym.sym == SDLK_f) {
+                sprite_render_stats_t stats = getSpriteRenderStats();
+                printf("Sprites: %d pixels drawn, %d skipped, overdraw factor %.2f\n",
+                    stats.pixelsDrawn, stats.pixelsSkipped, stats.overdrawFactor);
+                setSpriteRenderMode(getSpriteRenderMode() == SPRITE_RENDER_FRONT_TO_BACK
+                    ? SPRITE_RENDER_BACK_TO_FRONT
+                    : SPRITE_RENDER_FRONT_TO_BACK);
+            }
+            if (sdl_event.key.keysym.sym == SDLK_p)
+                setPalettizedMode(!isPalettizedMode());
+            if (sdl_event.key.keysym.sym == SDLK_t) {
+                texture_residency_stats_t stats = getTextureResidencyStats();
+                printf("Textures: %d resident (%d mapped), %zu/%zu bytes decoded (%zu byte atlas), %d hits, %d misses, %d prefetched, %d evicted\n",
+                    stats.numResident, stats.numMapped, stats.decodedBytes, stats.budgetBytes, stats.atlasBytes,
+                    stats.hits, stats.misses, stats.prefetched, stats.evicted);
+                printf("Decoding: %d allocations, %d from the heap, %zu bytes of scratch arenas\n",
+                    stats.decodeAllocations, stats.decodeHeapAllocations, stats.scratchBytes);
+            }
             break;
         }
         case SDL_KEYUP: {
@@ -51,22 +86,111 @@ void readInput() {
 void update(float dt) {
     movePlayer(dt);
     castRays();
+    updateSprites(dt);
+    updateTextureResidency(getPlayer().x, getPlayer().y);
 }
 
 void render(float dt) {
+    render_context_t* context = getMainRenderContext();
+    if (frameRing.header != NULL)
+        setRenderTarget(context, beginFramePublish(&frameRing));
     clearBuffer();
     drawWallProjection();
     drawSpriteProjection();
     if (game.showMiniMap)
         draw_mini_map();
     swapBuffer();
+    if (frameRing.header != NULL)
+        endFramePublish(&frameRing, context->x, context->y, context->angle);
+}
+
+/*
+ * Function: saveFrame
+ * -------------------
+ * Saves the frame just rendered when frames are dumped
+ * 
+ * int frame: Frame number
+ * 
+ * returns: void
+ */
+void saveFrame(int frame) {
+    char path[1024];
+    if (options.ppmPrefix == NULL)
+        return;
+    snprintf(path, sizeof(path), "%s%05d.ppm", options.ppmPrefix, frame);
+    if (!saveFramePPM(path))
+        options.ppmPrefix = NULL;
+}
+
+/*
+ * Function: parseOptions
+ * -------------------
+ *   raycast [--headless frames] [--minimap] [--ppm prefix] [--shm name]
+ * 
+ * returns: true/false if the command line is valid
+ */
+bool parseOptions(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+            options.headlessFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ppm") == 0 && i + 1 < argc)
+            options.ppmPrefix = argv[++i];
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+            options.shmName = argv[++i];
+        else if (strcmp(argv[i], "--minimap") == 0)
+            game.showMiniMap = true;
+        else {
+            fprintf(stderr, "Usage: %s [--headless frames] [--minimap] [--ppm prefix] [--shm name]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: runHeadless
+ * -------------------
+ * Renders a number of frames without a window or input, with a fixed
+ * time step, and prints the rendering speed
+ * 
+ * returns: process exit code
+ */
+int runHeadless() {
+    if (!initializeHeadless(NULL))
+        return 1;
+    initializePlayer();
+
+    double elapsed = 0;
+    for (int frame = 0; frame < options.headlessFrames; frame++) {
+        clock_t start = clock();
+        update(1.0f / FPS);
+        render(1.0f / FPS);
+        elapsed += (double)(clock() - start) / CLOCKS_PER_SEC;
+        saveFrame(frame);
+    }
+    printf("Rendered %d frames in %.3f s (%.1f frames per second)\n",
+        options.headlessFrames, elapsed, elapsed > 0 ? options.headlessFrames / elapsed : 0);
+
+    destroyResources();
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
+    if (!parseOptions(argc, argv))
+        return 1;
+    if (options.shmName != NULL && !createFrameRing(&frameRing, options.shmName, WINDOW_WIDTH, WINDOW_HEIGHT, FRAME_RING_SLOTS))
+        return 1;
+    if (options.headlessFrames > 0) {
+        int status = runHeadless();
+        closeFrameRing(&frameRing);
+        return status;
+    }
+
     game.isGameRunning = initializeWindow();
     int ticksLastFrame = 0;
     int timeToWait = 0;
     float dt = 0;
+    int frame = 0;
 
     initializePlayer();
 
@@ -83,9 +207,11 @@ int main(int argc, char *argv[]) {
 
         update(dt);
         render(dt);
+        saveFrame(frame++);
     }
 
     destroyResources();
+    closeFrameRing(&frameRing);
 
     return 0;
 }
@@ -0,0 +1,129 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "mapfile.h"
+
+/*
+ * Function: readFile
+ * -------------------
+ * Fallback for mapFile(): reads the whole file into a heap buffer
+ * 
+ * const char* path: File path
+ * mapped_file_t* file: Receives the file contents
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool readFile(const char* path, mapped_file_t* file) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    unsigned char* data = size > 0 ? malloc(size) : NULL;
+    if (data == NULL || fread(data, 1, size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    file->data = data;
+    file->size = size;
+    file->mapped = false;
+    return true;
+}
+
+/*
+ * Function: mapFile
+ * -------------------
+ * Maps a whole file read-only into memory. Pages are shared with the OS
+ * file cache and only loaded when touched. Platforms without mmap read
+ * the file instead.
+ * 
+ * const char* path: File path
+ * mapped_file_t* file: Receives the view of the file
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool mapFile(const char* path, mapped_file_t* file) {
+    memset(file, 0, sizeof(*file));
+#if defined(_WIN32)
+    return readFile(path, file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return readFile(path, file);
+
+    file->data = data;
+    file->size = info.st_size;
+    file->mapped = true;
+    return true;
+#endif
+}
+
+/*
+ * Function: unmapFile
+ * -------------------
+ * Releases a view created by mapFile()
+ * 
+ * mapped_file_t* file: View of the file
+ * 
+ * returns: void
+ */
+void unmapFile(mapped_file_t* file) {
+    if (file->data == NULL)
+        return;
+#if !defined(_WIN32)
+    if (file->mapped)
+        munmap((void*)file->data, file->size);
+    else
+#endif
+        free((void*)file->data);
+    memset(file, 0, sizeof(*file));
+}
+
+/*
+ * Function: getFileInfo
+ * -------------------
+ * Returns the size and modification time of a file
+ * 
+ * const char* path: File path
+ * uint64_t* size: Receives the size in bytes
+ * int64_t* mtime: Receives the modification time
+ * 
+ * returns: true/false if the file exists
+ */
+bool getFileInfo(const char* path, uint64_t* size, int64_t* mtime) {
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    *size = (uint64_t)info.st_size;
+    *mtime = (int64_t)info.st_mtime;
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only view of a whole file
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    bool mapped;    // true: data comes from mmap, false: from malloc
+} mapped_file_t;
+
+bool mapFile(const char* path, mapped_file_t* file);
+void unmapFile(mapped_file_t* file);
+bool getFileInfo(const char* path, uint64_t* size, int64_t* mtime);
+
+#endif
@@ -0,0 +1,85 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "observation.h"
+#include "render.h"
+
+/*
+ * Function: initObservationRenderer
+ * -------------------
+ * Sets up a renderer for frames of one size. The textures and sprites
+ * must be loaded already, e.g. by initializeHeadless().
+ * 
+ * observation_renderer_t* renderer: Renderer to set up
+ * int width, height: Frame size, at most WINDOW_WIDTH x WINDOW_HEIGHT
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool initObservationRenderer(observation_renderer_t* renderer, int width, int height) {
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->width = width;
+    renderer->height = height;
+    renderer->contexts = (render_context_t*) calloc(OBSERVATION_BATCH_VIEWS, sizeof(render_context_t));
+    if (renderer->contexts == NULL) {
+        fprintf(stderr, "Error allocating the observation renderer.\n");
+        return false;
+    }
+    for (int i = 0; i < OBSERVATION_BATCH_VIEWS; i++) {
+        renderer->views[i] = &renderer->contexts[i];
+        if (!initRenderContext(renderer->views[i], NULL, width, height)) {
+            freeObservationRenderer(renderer);
+            return false;
+        }
+    }
+    return true;
+}
+
+void freeObservationRenderer(observation_renderer_t* renderer) {
+    if (renderer->contexts != NULL) {
+        for (int i = 0; i < OBSERVATION_BATCH_VIEWS; i++)
+            freeRenderContext(&renderer->contexts[i]);
+    }
+    free(renderer->contexts);
+    memset(renderer, 0, sizeof(*renderer));
+}
+
+/*
+ * Function: renderObservations
+ * -------------------
+ * Draws the frame of every pose straight into its slot of the output,
+ * OBSERVATION_BATCH_VIEWS poses at a time spread over the CPUs. Frames are
+ * 32-bit ABGR pixels, row-major, stored one after the other: the frame of
+ * pose i starts at frames + i * width * height. A pose off the map,
+ * inside a wall or with a non-finite angle is not rendered: its frame is
+ * left empty, all pixels 0. Rays cast from inside a wall would leave the
+ * map on its border tiles.
+ * 
+ * observation_renderer_t* renderer: Renderer
+ * const camera_pose_t* poses: Cameras, one per frame
+ * int numPoses: Number of poses
+ * uint32_t* frames: numPoses * width * height pixels
+ * 
+ * returns: void
+ */
+void renderObservations(observation_renderer_t* renderer, const camera_pose_t* poses, int numPoses, uint32_t* frames) {
+    size_t frameSize = (size_t)renderer->width * renderer->height;
+    int numViews = 0;
+    for (int i = 0; i < numPoses; i++) {
+        const camera_pose_t* pose = &poses[i];
+        uint32_t* frame = frames + i * frameSize;
+        if (!isInMap(pose->x, pose->y) || mapHasWallAt(pose->x, pose->y) || !isfinite(pose->angle)) {
+            memset(frame, 0, frameSize * sizeof(uint32_t));
+        } else {
+            setRenderCamera(renderer->views[numViews], pose->x, pose->y, pose->angle);
+            setRenderTarget(renderer->views[numViews], frame);
+            numViews++;
+        }
+        if (numViews == OBSERVATION_BATCH_VIEWS || (i == numPoses - 1 && numViews > 0)) {
+            renderViews(renderer->views, numViews);
+            numViews = 0;
+        }
+    }
+}
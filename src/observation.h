@@ -0,0 +1,32 @@
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "render.h"
+
+// Views renderObservations() hands to renderViews() at once
+#define OBSERVATION_BATCH_VIEWS 64
+
+// Camera of one agent
+typedef struct {
+    float x;
+    float y;
+    float angle;
+} camera_pose_t;
+
+// Renders first-person frames of many agents into one buffer, without a
+// window. The render contexts are reused from batch to batch, each one
+// pointed at the frame of the agent it draws.
+typedef struct {
+    int width;
+    int height;
+    render_context_t* contexts;
+    render_context_t* views[OBSERVATION_BATCH_VIEWS];
+} observation_renderer_t;
+
+bool initObservationRenderer(observation_renderer_t* renderer, int width, int height);
+void freeObservationRenderer(observation_renderer_t* renderer);
+void renderObservations(observation_renderer_t* renderer, const camera_pose_t* poses, int numPoses, uint32_t* frames);
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "palette.h"
+
+// Shared palette: a 6x6x6 color cube followed by a ramp of grays, which
+// the stone and metal textures lean on. Colors are 32-bit ABGR like the
+// rest of the renderer.
+#define PALETTE_CUBE_LEVELS 6
+#define PALETTE_CUBE_STEP 51
+#define PALETTE_GRAYS (PALETTE_SIZE - PALETTE_CUBE_LEVELS * PALETTE_CUBE_LEVELS * PALETTE_CUBE_LEVELS)
+
+// Nearest palette index of every color, looked up with 5 bits per channel
+#define INVERSE_BITS 5
+#define INVERSE_SIZE (1 << (3 * INVERSE_BITS))
+
+static uint32_t palette[PALETTE_SIZE];
+static uint8_t* inversePalette;
+static uint8_t colormap[COLORMAP_LEVELS][PALETTE_SIZE];
+static bool palettized;
+
+// 4x4 ordered dither thresholds, spread over [-8, 7] (a quarter of a cube step once scaled)
+static const int8_t bayer[4][4] = {
+    { -8,  0, -6,  2 },
+    {  4, -4,  6, -2 },
+    { -5,  3, -7,  1 },
+    {  7, -1,  5, -3 }
+};
+
+static int channel(uint32_t color, int shift) {
+    return (color >> shift) & 0xFF;
+}
+
+/*
+ * Function: findNearestColor
+ * -------------------
+ * Searches the palette for the smallest squared RGB distance
+ * 
+ * int r, g, b: Color channels
+ * 
+ * returns: uint8_t Palette index
+ */
+static uint8_t findNearestColor(int r, int g, int b) {
+    int best = 0, bestDistance = 0x7FFFFFFF;
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        int dr = channel(palette[i], 0) - r;
+        int dg = channel(palette[i], 8) - g;
+        int db = channel(palette[i], 16) - b;
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    return (uint8_t)best;
+}
+
+/*
+ * Function: initPalette
+ * -------------------
+ * Builds the palette, the inverse lookup table and the colormap. Runs
+ * once, the first time the palettized mode is enabled.
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool initPalette(void) {
+    if (inversePalette != NULL)
+        return true;
+    inversePalette = malloc(INVERSE_SIZE);
+    if (inversePalette == NULL)
+        return false;
+
+    int n = 0;
+    for (int b = 0; b < PALETTE_CUBE_LEVELS; b++)
+        for (int g = 0; g < PALETTE_CUBE_LEVELS; g++)
+            for (int r = 0; r < PALETTE_CUBE_LEVELS; r++)
+                palette[n++] = 0xFF000000 | (b * PALETTE_CUBE_STEP) << 16 | (g * PALETTE_CUBE_STEP) << 8 | (r * PALETTE_CUBE_STEP);
+    for (int i = 0; i < PALETTE_GRAYS; i++) {
+        uint32_t gray = (i + 1) * 255 / (PALETTE_GRAYS + 1);
+        palette[n++] = 0xFF000000 | gray << 16 | gray << 8 | gray;
+    }
+
+    // Channel values at the center of every 5-bit bucket
+    for (int i = 0; i < INVERSE_SIZE; i++) {
+        int r = ((i & 31) << 3) | 4;
+        int g = (((i >> 5) & 31) << 3) | 4;
+        int b = (((i >> 10) & 31) << 3) | 4;
+        inversePalette[i] = findNearestColor(r, g, b);
+    }
+
+    // Same scaling as changeColorIntensity(), level l is l / (COLORMAP_LEVELS - 1)
+    for (int level = 0; level < COLORMAP_LEVELS; level++) {
+        for (int i = 0; i < PALETTE_SIZE; i++) {
+            int r = channel(palette[i], 0) * level / (COLORMAP_LEVELS - 1);
+            int g = channel(palette[i], 8) * level / (COLORMAP_LEVELS - 1);
+            int b = channel(palette[i], 16) * level / (COLORMAP_LEVELS - 1);
+            colormap[level][i] = findNearestColor(r, g, b);
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: setPalettizedMode
+ * -------------------
+ * Switches rendering between 32-bit colors and 8-bit palette indices.
+ * In palettized mode textures are sampled as indices, shaded through the
+ * colormap, and drawn into an 8-bit framebuffer that is expanded with the
+ * palette when presented.
+ * 
+ * bool enabled: true for 8-bit rendering
+ * 
+ * returns: void
+ */
+void setPalettizedMode(bool enabled) {
+    palettized = enabled && initPalette();
+}
+
+bool isPalettizedMode(void) {
+    return palettized;
+}
+
+const uint32_t* getPalette(void) {
+    return palette;
+}
+
+/*
+ * Function: getPaletteIndex
+ * -------------------
+ * Returns the palette entry closest to a 32-bit color
+ * 
+ * uint32_t color: ABGR color
+ * 
+ * returns: uint8_t Palette index
+ */
+uint8_t getPaletteIndex(uint32_t color) {
+    int r = channel(color, 0) >> (8 - INVERSE_BITS);
+    int g = channel(color, 8) >> (8 - INVERSE_BITS);
+    int b = channel(color, 16) >> (8 - INVERSE_BITS);
+    return inversePalette[(b << (2 * INVERSE_BITS)) | (g << INVERSE_BITS) | r];
+}
+
+/*
+ * Function: getColormap
+ * -------------------
+ * Returns the colormap row for a shading factor: the palette index each
+ * index turns into at that brightness
+ * 
+ * float factor: Intensity between 0 and 1, clamped
+ * 
+ * returns: const uint8_t* PALETTE_SIZE indices
+ */
+const uint8_t* getColormap(float factor) {
+    factor = (factor > 1.0) ? 1.0 : ((factor < 0.0) ? 0.0 : factor);
+    return colormap[(int)(factor * (COLORMAP_LEVELS - 1) + 0.5f)];
+}
+
+/*
+ * Function: quantizePixels
+ * -------------------
+ * Converts an image to palette indices. A 4x4 ordered dither breaks up
+ * the banding of smooth gradients between palette colors.
+ * 
+ * const uint32_t* pixels: ABGR pixels, row-major
+ * uint8_t* indices: Receives width * height indices
+ * int width: Image width
+ * int height: Image height
+ * 
+ * returns: void
+ */
+void quantizePixels(const uint32_t* pixels, uint8_t* indices, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t color = pixels[y * width + x];
+            int offset = bayer[y & 3][x & 3] * PALETTE_CUBE_STEP / 32;
+            uint32_t dithered = color & 0xFF000000;
+            for (int shift = 0; shift < 24; shift += 8) {
+                int c = channel(color, shift) + offset;
+                c = c < 0 ? 0 : (c > 255 ? 255 : c);
+                dithered |= (uint32_t)c << shift;
+            }
+            indices[y * width + x] = getPaletteIndex(dithered);
+        }
+    }
+}
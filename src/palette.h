@@ -0,0 +1,19 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PALETTE_SIZE 256
+// Brightness steps of the colormap, from black to full intensity
+#define COLORMAP_LEVELS 32
+
+bool initPalette(void);
+void setPalettizedMode(bool enabled);
+bool isPalettizedMode(void);
+const uint32_t* getPalette(void);
+uint8_t getPaletteIndex(uint32_t color);
+const uint8_t* getColormap(float factor);
+void quantizePixels(const uint32_t* pixels, uint8_t* indices, int width, int height);
+
+#endif
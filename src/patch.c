@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "palette.h"
+#include "patch.h"
+
+/*
+ * Function: isTransparent
+ * -------------------
+ * A texel is transparent when it has the key color or a zero alpha
+ * 
+ * uint32_t color: Texel color
+ * uint32_t transparentColor: Key color
+ * 
+ * returns: true/false if the texel is transparent
+ */
+static bool isTransparent(uint32_t color, uint32_t transparentColor) {
+    return color == transparentColor || (color & 0xFF000000) == 0;
+}
+
+/*
+ * Function: buildPatch
+ * -------------------
+ * Compiles a row-major texture into per-column runs of opaque texels.
+ * The first pass counts runs and texels, the second one fills them.
+ * 
+ * patch_t* patch: Patch to build
+ * const uint32_t* pixels: Row-major texture texels
+ * int width: Texture width
+ * int height: Texture height
+ * uint32_t transparentColor: Texels of this color are dropped, like fully
+ * transparent ones
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool buildPatch(patch_t* patch, const uint32_t* pixels, int width, int height, uint32_t transparentColor) {
+    memset(patch, 0, sizeof(*patch));
+    if (pixels == NULL || width <= 0 || height <= 0 || height > UINT16_MAX)
+        return false;
+
+    int numSpans = 0;
+    int numTexels = 0;
+    for (int x = 0; x < width; x++) {
+        bool inSpan = false;
+        for (int y = 0; y < height; y++) {
+            bool opaque = !isTransparent(pixels[(width * y) + x], transparentColor);
+            if (opaque) {
+                numTexels++;
+                if (!inSpan)
+                    numSpans++;
+            }
+            inSpan = opaque;
+        }
+    }
+
+    patch->columns = malloc(sizeof(uint32_t) * (width + 1));
+    patch->spans = malloc(sizeof(patch_span_t) * (numSpans ? numSpans : 1));
+    patch->texels = malloc(sizeof(uint32_t) * (numTexels ? numTexels : 1));
+    if (patch->columns == NULL || patch->spans == NULL || patch->texels == NULL) {
+        fprintf(stderr, "Error allocating a %dx%d patch.\n", width, height);
+        freePatch(patch);
+        return false;
+    }
+    patch->width = width;
+    patch->height = height;
+    patch->numTexels = numTexels;
+
+    int span = 0;
+    int texel = 0;
+    for (int x = 0; x < width; x++) {
+        patch->columns[x] = span;
+        for (int y = 0; y < height; y++) {
+            uint32_t color = pixels[(width * y) + x];
+            if (isTransparent(color, transparentColor))
+                continue;
+            if (y == 0 || isTransparent(pixels[(width * (y - 1)) + x], transparentColor)) {
+                patch->spans[span].top = y;
+                patch->spans[span].length = 0;
+                patch->spans[span].offset = texel;
+                span++;
+            }
+            patch->spans[span - 1].length++;
+            patch->texels[texel++] = color;
+        }
+    }
+    patch->columns[width] = span;
+    return true;
+}
+
+/*
+ * Function: buildPatchIndices
+ * -------------------
+ * Adds the palette index of every opaque texel, for palettized rendering.
+ * Texels are quantized one by one, without dithering: their screen
+ * position is only known when drawn.
+ * 
+ * patch_t* patch: Compiled patch
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool buildPatchIndices(patch_t* patch) {
+    if (patch->indices != NULL)
+        return true;
+    if (patch->width == 0)
+        return false;
+
+    patch->indices = malloc(patch->numTexels ? patch->numTexels : 1);
+    if (patch->indices == NULL)
+        return false;
+    for (int i = 0; i < patch->numTexels; i++)
+        patch->indices[i] = getPaletteIndex(patch->texels[i]);
+    return true;
+}
+
+/*
+ * Function: freePatch
+ * -------------------
+ * Free the memory held by a patch
+ * 
+ * patch_t* patch: Patch to free
+ * 
+ * returns: void
+ */
+void freePatch(patch_t* patch) {
+    free(patch->columns);
+    free(patch->spans);
+    free(patch->texels);
+    free(patch->indices);
+    memset(patch, 0, sizeof(*patch));
+}
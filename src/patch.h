@@ -0,0 +1,30 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Run of opaque texels in one texture column, like the posts of a Doom patch
+typedef struct {
+    uint16_t top;       // First texel row of the run
+    uint16_t length;    // Number of opaque texels
+    uint32_t offset;    // Index of the first texel of the run in texels
+} patch_span_t;
+
+// Texture compiled into per-column lists of opaque runs. Transparent texels
+// are not stored at all, so drawing a patch never tests for transparency.
+typedef struct {
+    int width;
+    int height;
+    int numTexels;
+    uint32_t* columns;      // Spans of column x are [columns[x], columns[x + 1])
+    patch_span_t* spans;
+    uint32_t* texels;       // Opaque texels, column by column
+    uint8_t* indices;       // Palette indices of texels, NULL until buildPatchIndices()
+} patch_t;
+
+bool buildPatch(patch_t* patch, const uint32_t* pixels, int width, int height, uint32_t transparentColor);
+bool buildPatchIndices(patch_t* patch);
+void freePatch(patch_t* patch);
+
+#endif
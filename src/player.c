@@ -16,6 +16,8 @@ void initializePlayer() {
     player.rotationAngle = PI/2;
     player.walkSpeed = 100;
     player.turnSpeed = 90 * (PI / 180);
+    player.minimap_x = ((float)MINIMAP_WIDTH_TILE_SIZE/TILE_SIZE) * player.x;
+    player.minimap_y = ((float)MINIMAP_HEIGHT_TILE_SIZE/TILE_SIZE) * player.y;
 }
 
 /*
@@ -37,8 +39,8 @@ void movePlayer(float dt) {
     if(!mapHasWallAt(newPlayerX, newPlayerY)) {
         player.x = newPlayerX;
         player.y = newPlayerY;
-        player.minimap_x = ((float)WINDOW_WIDTH/MAP_WIDTH) * player.x;
-        player.minimap_y = ((float)WINDOW_HEIGHT/MAP_HEIGHT) * player.y;
+        player.minimap_x = ((float)MINIMAP_WIDTH_TILE_SIZE/TILE_SIZE) * player.x;
+        player.minimap_y = ((float)MINIMAP_HEIGHT_TILE_SIZE/TILE_SIZE) * player.y;
     }
 }
 
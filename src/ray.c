@@ -5,20 +5,42 @@
 #include "map.h"
 #include "player.h"
 #include "ray.h"
+#include "render.h"
 #include "utils.h"
 
 /*
  * Function: castRays
  * -------------------
- * Cast rays from the player position considering a FOV angle
+ * Cast rays from the player position considering a FOV angle, into the
+ * main render context
  * 
  * returns: void
  */
 void castRays() {
     struct Player player = getPlayer();
-    for (int column = 0; column < NUM_RAYS; column++) {
-        float angle = player.rotationAngle + atan((column-NUM_RAYS/2) / DIST_PROJ_PLANE);
-        castRay(angle, player.x, player.y, column);
+    render_context_t* context = getMainRenderContext();
+    setRenderCamera(context, player.x, player.y, player.rotationAngle);
+    castRaysFrom(context->x, context->y, context->angle, context->rays, NUM_RAYS);
+}
+
+/*
+ * Function: castRaysFrom
+ * -------------------
+ * Cast one ray per column of a frame from a camera. Only the map is read,
+ * so several cameras can cast at once.
+ * 
+ * float x: Horizontal coordinate of the camera
+ * float y: Vertical coordinate of the camera
+ * float angle: Camera direction
+ * struct Ray* rays: Rays receiving the hits
+ * int numRays: Number of rays, the width of the frame
+ * 
+ * returns: void
+ */
+void castRaysFrom(float x, float y, float angle, struct Ray* rays, int numRays) {
+    for (int column = 0; column < numRays; column++) {
+        float rayAngle = angle + atan((column-numRays/2) / DIST_PROJ_PLANE_FOR(numRays));
+        castRay(rayAngle, x, y, &rays[column]);
     }
 }
 
@@ -26,7 +48,7 @@ void castRays() {
  * Function: castRay
  * -------------------
  * Cast a ray from a specific coordinate (x,y) and angle. Once the
- * ray hits a wall, it stores information in the rays array.
+ * ray hits a wall, it stores information in the ray.
  * 
  * DDA algorithm:
  * To be more efficient, instead of checking every single pixel of
@@ -36,11 +58,11 @@ void castRays() {
  * float rayAngle: angle of the ray from the player position
  * float x: Horizontal coordinate
  * float y: Vertical coordinate
- * int stripId: Ray index
+ * struct Ray* ray: Receives the hit
  * 
  * returns: void
  */
-void castRay(float rayAngle, float x, float y, int stripId) {
+void castRay(float rayAngle, float x, float y, struct Ray* ray) {
     normalizeAngle(&rayAngle);
     
     // Which direction is the player facing?
@@ -146,21 +168,21 @@ void castRay(float rayAngle, float x, float y, int stripId) {
         ? distanceBetweenPoints(x, y, vertWallHitX, vertWallHitY)
         : FLT_MAX;
 
-    // Information about the hit (e.g. coordinates or map content) is stored in the array of rays
+    // Information about the hit (e.g. coordinates or map content) is stored in the ray
     if (vertHitDistance < horzHitDistance) {
-        rays[stripId].distance = vertHitDistance;
-        rays[stripId].wallHitX = vertWallHitX;
-        rays[stripId].wallHitY = vertWallHitY;
-        rays[stripId].textureIndex = vertWallTexture;
-        rays[stripId].wasHitVertical = true;
-        rays[stripId].rayAngle = rayAngle;
+        ray->distance = vertHitDistance;
+        ray->wallHitX = vertWallHitX;
+        ray->wallHitY = vertWallHitY;
+        ray->textureIndex = vertWallTexture;
+        ray->wasHitVertical = true;
+        ray->rayAngle = rayAngle;
     } else {
-        rays[stripId].distance = horzHitDistance;
-        rays[stripId].wallHitX = horzWallHitX;
-        rays[stripId].wallHitY = horzWallHitY;
-        rays[stripId].textureIndex = horzWallTexture;
-        rays[stripId].wasHitVertical = false;
-        rays[stripId].rayAngle = rayAngle;
+        ray->distance = horzHitDistance;
+        ray->wallHitX = horzWallHitX;
+        ray->wallHitY = horzWallHitY;
+        ray->textureIndex = horzWallTexture;
+        ray->wasHitVertical = false;
+        ray->rayAngle = rayAngle;
     }
 }
 
@@ -175,7 +197,7 @@ void castRay(float rayAngle, float x, float y, int stripId) {
  * returns: float X coordinate
  */
 float getRayWallHitX(int i) {
-    return rays[i].wallHitX;
+    return getMainRenderContext()->rays[i].wallHitX;
 }
 
 /*
@@ -189,7 +211,7 @@ float getRayWallHitX(int i) {
  * returns: float Y coordinate
  */
 float getRayWallHitY(int i) {
-    return rays[i].wallHitY;
+    return getMainRenderContext()->rays[i].wallHitY;
 }
 
 /*
@@ -202,7 +224,7 @@ float getRayWallHitY(int i) {
  * returns: float distance
  */
 float getRayWallHitDistance(int i) {
-    return rays[i].distance;
+    return getMainRenderContext()->rays[i].distance;
 }
 
 /*
@@ -215,7 +237,7 @@ float getRayWallHitDistance(int i) {
  * returns: float Ray angle
  */
 float getRayAngle(int i) {
-    return rays[i].rayAngle;
+    return getMainRenderContext()->rays[i].rayAngle;
 }
 
 /*
@@ -228,7 +250,7 @@ float getRayAngle(int i) {
  * returns: float Ray angle
  */
 int getRayWasHitVertical(int i) {
-    return rays[i].wasHitVertical;
+    return getMainRenderContext()->rays[i].wasHitVertical;
 }
 
 /*
@@ -241,5 +263,5 @@ int getRayWasHitVertical(int i) {
  * returns: int Content of the hit wall
  */
 int getRayHitTexture(int i) {
-    return rays[i].textureIndex;
+    return getMainRenderContext()->rays[i].textureIndex;
 }
\ No newline at end of file
@@ -10,10 +10,11 @@ struct Ray {
     float distance;
     bool wasHitVertical;
     int textureIndex;
-} rays[NUM_RAYS];
+};
 
 void castRays();
-void castRay(float rayAngle, float x, float y, int stripId);
+void castRaysFrom(float x, float y, float angle, struct Ray* rays, int numRays);
+void castRay(float rayAngle, float x, float y, struct Ray* ray);
 float getRayWallHitX(int i);
 float getRayWallHitY(int i);
 float getRayWallHitDistance(int i);
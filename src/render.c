@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "display.h"
+#include "ray.h"
+#include "render.h"
+#include "sprite.h"
+#include "textures.h"
+
+// View of the player, drawn by the functions without a context argument
+static render_context_t mainContext;
+
+// One pass of renderViews(): contexts are handed out to the threads one at a time
+typedef struct {
+    render_context_t** contexts;
+    int numContexts;
+    SDL_atomic_t nextContext;
+    void (*pass)(render_context_t* context);
+} render_work_t;
+
+/*
+ * Function: initRenderContext
+ * -------------------
+ * Sets up a context with its frame buffers. The camera starts at the
+ * origin; place it with setRenderCamera().
+ * 
+ * render_context_t* context: Context to set up
+ * uint32_t* target: width x height pixels owned by the caller, or NULL to allocate them
+ * int width, height: Frame size, at most WINDOW_WIDTH x WINDOW_HEIGHT
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool initRenderContext(render_context_t* context, uint32_t* target, int width, int height) {
+    memset(context, 0, sizeof(*context));
+    if (width <= 0 || width > WINDOW_WIDTH || height <= 0 || height > WINDOW_HEIGHT) {
+        fprintf(stderr, "Invalid frame size %dx%d.\n", width, height);
+        return false;
+    }
+    context->width = width;
+    context->height = height;
+    context->ownsColorBuffer = target == NULL;
+    context->colorBuffer = target != NULL ? target : (uint32_t*) malloc(sizeof(uint32_t) * width * height);
+    context->indexBuffer = (uint8_t*) malloc((size_t)width * height);
+    if (context->colorBuffer == NULL || context->indexBuffer == NULL) {
+        fprintf(stderr, "Error allocating the frame buffers.\n");
+        freeRenderContext(context);
+        return false;
+    }
+    return true;
+}
+
+void freeRenderContext(render_context_t* context) {
+    if (context->ownsColorBuffer)
+        free(context->colorBuffer);
+    free(context->indexBuffer);
+    freeSpriteView(&context->sprites);
+    memset(context, 0, sizeof(*context));
+}
+
+render_context_t* getMainRenderContext(void) {
+    return &mainContext;
+}
+
+void setRenderCamera(render_context_t* context, float x, float y, float angle) {
+    context->x = x;
+    context->y = y;
+    context->angle = angle;
+}
+
+/*
+ * Function: setRenderTarget
+ * -------------------
+ * Points the next frames of a context at pixels owned by the caller,
+ * releasing the buffer the context allocated, if any
+ * 
+ * render_context_t* context: Context
+ * uint32_t* target: width x height pixels
+ * 
+ * returns: void
+ */
+void setRenderTarget(render_context_t* context, uint32_t* target) {
+    if (context->ownsColorBuffer)
+        free(context->colorBuffer);
+    context->ownsColorBuffer = false;
+    context->colorBuffer = target;
+}
+
+/*
+ * Function: castView
+ * -------------------
+ * Casts the rays of a context and finds the sprites it sees
+ * 
+ * render_context_t* context: Context
+ * 
+ * returns: void
+ */
+static void castView(render_context_t* context) {
+    castRaysFrom(context->x, context->y, context->angle, context->rays, context->width);
+    updateSpriteView(&context->sprites, context->x, context->y, context->angle);
+}
+
+/*
+ * Function: prepareView
+ * -------------------
+ * Decodes the wall textures the rays of a context hit and compiles the
+ * patches of the sprites it sees. Runs on the calling thread: it's the
+ * only step that changes shared data.
+ * 
+ * render_context_t* context: Context, with its rays cast
+ * 
+ * returns: void
+ */
+static void prepareView(render_context_t* context) {
+    bool used[NUM_TEXTURES] = { false };
+    for (int i = 0; i < context->width; i++) {
+        int texture = context->rays[i].textureIndex - 1;
+        if (texture >= 0 && texture < NUM_TEXTURES)
+            used[texture] = true;
+    }
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        if (used[i])
+            getTexture(i);
+    }
+    prepareSpriteView(&context->sprites);
+}
+
+/*
+ * Function: drawView
+ * -------------------
+ * Draws a frame of a context, reading only its own state and the shared
+ * data made ready by prepareView()
+ * 
+ * render_context_t* context: Context
+ * 
+ * returns: void
+ */
+static void drawView(render_context_t* context) {
+    clearView(context);
+    drawWallView(context);
+    drawSpriteView(context);
+    if (context->showMiniMap && context->width == WINDOW_WIDTH && context->height == WINDOW_HEIGHT)
+        drawMiniMapView(context);
+    resolveView(context);
+}
+
+static int renderThread(void* data) {
+    render_work_t* work = data;
+    int i;
+    while ((i = SDL_AtomicAdd(&work->nextContext, 1)) < work->numContexts)
+        work->pass(work->contexts[i]);
+    return 0;
+}
+
+/*
+ * Function: runRenderPass
+ * -------------------
+ * Runs a pass over every context, spread over up to one thread per CPU.
+ * The calling thread works too and returns once every context is done.
+ * 
+ * render_context_t** contexts: Contexts
+ * int numContexts: Number of contexts
+ * void (*pass)(render_context_t*): Work for one context
+ * 
+ * returns: void
+ */
+static void runRenderPass(render_context_t** contexts, int numContexts, void (*pass)(render_context_t* context)) {
+    SDL_Thread* threads[RENDER_MAX_THREADS];
+    render_work_t work = { .contexts = contexts, .numContexts = numContexts, .pass = pass };
+
+    int numThreads = SDL_GetCPUCount();
+    numThreads = numThreads > RENDER_MAX_THREADS ? RENDER_MAX_THREADS : numThreads;
+    numThreads = numThreads > numContexts ? numContexts : numThreads;
+
+    SDL_AtomicSet(&work.nextContext, 0);
+
+    int numStarted = 0;
+    for (int i = 1; i < numThreads; i++) {
+        threads[numStarted] = SDL_CreateThread(renderThread, "Renderer", &work);
+        if (threads[numStarted] != NULL)
+            numStarted++;
+    }
+    renderThread(&work);
+    for (int i = 0; i < numStarted; i++)
+        SDL_WaitThread(threads[i], NULL);
+}
+
+/*
+ * Function: renderViews
+ * -------------------
+ * Draws a frame of every context, each from its own camera into its own
+ * target. Rays are cast and frames drawn on several threads; in between,
+ * the textures every view needs are made resident on the calling thread,
+ * so while the views are drawn the shared data is only read. Sprites and
+ * textures must not be changed from other threads meanwhile.
+ * 
+ * render_context_t** contexts: Contexts to draw, all different
+ * int numContexts: Number of contexts
+ * 
+ * returns: void
+ */
+void renderViews(render_context_t** contexts, int numContexts) {
+    if (numContexts <= 0)
+        return;
+    runRenderPass(contexts, numContexts, castView);
+    for (int i = 0; i < numContexts; i++)
+        prepareView(contexts[i]);
+    runRenderPass(contexts, numContexts, drawView);
+}
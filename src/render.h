@@ -0,0 +1,48 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "app.h"
+#include "ray.h"
+#include "sprite.h"
+
+// Most threads renderViews() draws with, the calling thread included
+#define RENDER_MAX_THREADS 16
+
+// One view of the level: a camera, the rays and sprites it sees, and the
+// frame it is drawn into. The map, the textures and the sprite pool are
+// shared by every context and only read while views are drawn, so
+// renderViews() can draw several contexts at once on different threads.
+// Frames can be smaller than the window, with one ray per column; the
+// minimap is only drawn on frames of the window size.
+typedef struct render_context {
+    // Camera
+    float x;
+    float y;
+    float angle;
+    bool showMiniMap;
+
+    struct Ray rays[NUM_RAYS];
+    sprite_view_t sprites;
+
+    // Target, width x height pixels, at most WINDOW_WIDTH x WINDOW_HEIGHT
+    int width;
+    int height;
+    uint32_t* colorBuffer;
+    uint8_t* indexBuffer;       // Palette indices, drawn instead of colorBuffer in palettized mode
+    bool ownsColorBuffer;       // colorBuffer was allocated here, not given by the caller
+
+    // Top left corner of the minimap view, in minimap pixels
+    int minimapX;
+    int minimapY;
+} render_context_t;
+
+bool initRenderContext(render_context_t* context, uint32_t* target, int width, int height);
+void freeRenderContext(render_context_t* context);
+render_context_t* getMainRenderContext(void);
+void setRenderCamera(render_context_t* context, float x, float y, float angle);
+void setRenderTarget(render_context_t* context, uint32_t* target);
+void renderViews(render_context_t** contexts, int numContexts);
+
+#endif
@@ -1,68 +1,551 @@
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "app.h"
 #include "display.h"
+#include "palette.h"
+#include "patch.h"
 #include "player.h"
 #include "ray.h"
+#include "render.h"
 #include "sprite.h"
 #include "textures.h"
 #include "utils.h"
 #include "upng.h"
 
-static sprite_t sprites[NUM_SPRITES] = {
+#define MAX_ANIMATION_FRAMES 8
+
+// Animations, indexed by sprite_animation_t. Frames are frameWidth-wide
+// column ranges of one texture (the atlas), so every sprite playing an
+// animation shares the same compiled texture. An animation lists the atlas
+// frames it plays in order, so it can skip frames of the sheet: the guard
+// sheet has an upright pain pose (frame 9) among the death frames.
+static const struct {
+    int textureIndex;
+    int frameWidth;
+    int frames[MAX_ANIMATION_FRAMES];
+    int numFrames;
+    float framesPerSecond;
+    bool loop;
+} animations[NUM_SPRITE_ANIMATIONS] = {
+    [SPRITE_ANIMATION_GUARD_WALK] = { .textureIndex = 8, .frameWidth = 64, .frames = { 1, 2, 3, 4 }, .numFrames = 4, .framesPerSecond = 6, .loop = true },
+    [SPRITE_ANIMATION_GUARD_SHOOT] = { .textureIndex = 8, .frameWidth = 64, .frames = { 11, 12 }, .numFrames = 2, .framesPerSecond = 3, .loop = true },
+    [SPRITE_ANIMATION_GUARD_DIE] = { .textureIndex = 8, .frameWidth = 64, .frames = { 6, 7, 8, 10 }, .numFrames = 4, .framesPerSecond = 8, .loop = false },
+};
+
+// Sprites placed in the level at load time, expressed as (i,j) grid cells
+static const struct {
+    int i;
+    int j;
+    int textureIndex;
+    sprite_animation_t animation;
+} levelSprites[] = {
     { .i = 3, .j = 11, .textureIndex = 4},
     { .i = 3, .j = 3, .textureIndex = 7},
     { .i = 1, .j = 5, .textureIndex = 6},
     { .i = 4, .j = 18, .textureIndex = 5},
     { .i = 8, .j = 4, .textureIndex = 7},
+    { .i = 6, .j = 3, .animation = SPRITE_ANIMATION_GUARD_WALK},
+    { .i = 2, .j = 15, .animation = SPRITE_ANIMATION_GUARD_SHOOT},
+    { .i = 10, .j = 12, .animation = SPRITE_ANIMATION_GUARD_WALK},
 };
 
+// Sprite textures compiled into opaque runs, indexed like the textures array
+static patch_t patches[NUM_TEXTURES];
+
+static sprite_render_mode_t renderMode = SPRITE_RENDER_BACK_TO_FRONT;
+
+// Sprite storage. Live sprites are packed at the front of the dense arrays
+// so the per-frame passes walk contiguous memory. Fields read every frame
+// (hot) live in their own arrays, apart from the bookkeeping only touched
+// on spawn/despawn (cold). Handles go through the slot table, so they stay
+// valid while sprites move around the dense arrays. What a camera sees of
+// the pool is kept apart, in a sprite_view_t per render context.
+static struct {
+    // Hot: dense, indexed by [0, count)
+    float* x;
+    float* y;
+    int* textureIndex;
+    int* frameColumn;       // First texture column of the current frame
+    int* frameWidth;        // 0 for the whole patch
+    int* animation;         // sprite_animation_t
+    float* animationTime;
+
+    // Cold: dense index -> slot, slot -> dense index / generation
+    uint32_t* denseToSlot;
+    uint32_t* slotToDense;
+    uint32_t* slotGeneration;
+    uint32_t* freeSlots;
+    int numFreeSlots;
+    int numSlots;
+    uint32_t despawns;      // Dense indices of views built before a despawn are stale
+
+    int count;
+    int capacity;
+} pool;
+
+// Every pool array, with the size of one element, so growing and freeing
+// the pool can't forget any of them
+#define SPRITE_POOL_ARRAYS(X) \
+    X(x) X(y) X(textureIndex) \
+    X(frameColumn) X(frameWidth) X(animation) X(animationTime) \
+    X(denseToSlot) X(slotToDense) X(slotGeneration) X(freeSlots)
+
+// Every array of a sprite view, grown with the pool
+#define SPRITE_VIEW_ARRAYS(X) \
+    X(distance) X(angle) X(visibleFrame) X(visible) X(sortPairs) X(sortScratch)
+
+/*
+ * Function: growSpritePool
+ * -------------------
+ * Resizes every pool array to hold "capacity" sprites. This is the only
+ * place where the sprite module allocates memory, so it only happens on
+ * spawn when the pool is full, never while rendering a frame.
+ * 
+ * int capacity: New number of sprites the pool can hold
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool growSpritePool(int capacity) {
+#define GROW_POOL_ARRAY(field) { \
+        void* resized = realloc(pool.field, sizeof(*pool.field) * capacity); \
+        if (resized == NULL) { \
+            fprintf(stderr, "Error growing the sprite pool to %d sprites.\n", capacity); \
+            return false; \
+        } \
+        pool.field = resized; \
+    }
+    SPRITE_POOL_ARRAYS(GROW_POOL_ARRAY)
+#undef GROW_POOL_ARRAY
+    pool.capacity = capacity;
+    return true;
+}
+
+/*
+ * Function: initSprites
+ * -------------------
+ * Reserves room for "capacity" sprites up front
+ * 
+ * int capacity: Number of sprites to reserve
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool initSprites(int capacity) {
+    if (capacity <= pool.capacity)
+        return true;
+    return growSpritePool(capacity);
+}
+
 /*
  * Function: loadSprites
  * -------------------
- * Translates (i,j) cell-grid positions onto (x,y) float coordinates
+ * Spawns the level sprites, translating (i,j) cell-grid positions onto
+ * (x,y) float coordinates
  * 
  * returns: void
  */
 void loadSprites() {
-    for (int i = 0; i < NUM_SPRITES; i++) {
-        sprites[i].x = sprites[i].j * TILE_SIZE + (float)TILE_SIZE / 2;
-        sprites[i].y = sprites[i].i * TILE_SIZE + (float)TILE_SIZE / 2;
+    if (!initSprites(SPRITE_POOL_INITIAL_CAPACITY))
+        return;
+    for (size_t i = 0; i < sizeof(levelSprites) / sizeof(levelSprites[0]); i++) {
+        float x = levelSprites[i].j * TILE_SIZE + (float)TILE_SIZE / 2;
+        float y = levelSprites[i].i * TILE_SIZE + (float)TILE_SIZE / 2;
+        if (levelSprites[i].animation != SPRITE_ANIMATION_NONE)
+            spawnAnimatedSprite(x, y, levelSprites[i].animation);
+        else
+            spawnSprite(x, y, levelSprites[i].textureIndex);
     }
 }
 
 /*
- * Function: drawSpritesInMiniMap
+ * Function: freeSprites
  * -------------------
- * Draw a small square in the minimap for sprites that are visible
+ * Release the memory held by the sprite pool
  * 
  * returns: void
  */
-void drawSpritesInMiniMap() {
-    for (int i = 0; i < NUM_SPRITES; i++) {
-        draw_rect(
-            sprites[i].x * ((float)WINDOW_WIDTH/MAP_WIDTH),
-            sprites[i].y * ((float)WINDOW_HEIGHT/MAP_HEIGHT),
-            5,
-            5,
-            0xFFFF0000
-        );
+void freeSprites() {
+    for (int i = 0; i < NUM_TEXTURES; i++)
+        freePatch(&patches[i]);
+#define FREE_POOL_ARRAY(field) free(pool.field);
+    SPRITE_POOL_ARRAYS(FREE_POOL_ARRAY)
+#undef FREE_POOL_ARRAY
+    memset(&pool, 0, sizeof(pool));
+}
+
+/*
+ * Function: getSpritePatch
+ * -------------------
+ * Returns the patch of a sprite texture, compiling it from the decoded
+ * texture the first time it is requested (and its palette indices the
+ * first time it is requested in palettized mode). The patch keeps its own
+ * copy of the texels, so the texture may be evicted afterwards.
+ * 
+ * int textureIndex: Index in the textures array
+ * 
+ * returns: const patch_t* Patch (empty when the texture is not loaded)
+ */
+static const patch_t* getSpritePatch(int textureIndex) {
+    patch_t* patch = &patches[textureIndex];
+    if (patch->width == 0) {
+        const texture_t* texture = getTexture(textureIndex);
+        if (texture->pixels != NULL)
+            buildPatch(patch, texture->pixels, texture->width, texture->height, SPRITE_TRANSPARENT_COLOR);
     }
+    if (isPalettizedMode() && patch->indices == NULL)
+        buildPatchIndices(patch);
+    return patch;
 }
+
 /*
- * Function: drawSpriteProjection
+ * Function: spawnSprite
  * -------------------
- * Draw the sprites projection on the screen for sprites that are visible
+ * Adds a sprite to the pool. The pool doubles its capacity when full.
+ * 
+ * float x: Horizontal coordinate
+ * float y: Vertical coordinate
+ * int textureIndex: Index in the textures array
+ * 
+ * returns: sprite_handle_t Handle to the sprite. Its generation is 0 when
+ * the texture index is out of range or the pool could not grow, which is
+ * never a valid handle.
+ */
+sprite_handle_t spawnSprite(float x, float y, int textureIndex) {
+    sprite_handle_t handle = { .slot = 0, .generation = 0 };
+    if (textureIndex < 0 || textureIndex >= NUM_TEXTURES)
+        return handle;
+    if (pool.count == pool.capacity) {
+        int capacity = pool.capacity ? pool.capacity * 2 : SPRITE_POOL_INITIAL_CAPACITY;
+        if (!growSpritePool(capacity))
+            return handle;
+    }
+
+    uint32_t slot;
+    if (pool.numFreeSlots > 0) {
+        slot = pool.freeSlots[--pool.numFreeSlots];
+    } else {
+        slot = pool.numSlots++;
+        pool.slotGeneration[slot] = 1;
+    }
+
+    int dense = pool.count++;
+    pool.x[dense] = x;
+    pool.y[dense] = y;
+    pool.textureIndex[dense] = textureIndex;
+    pool.frameColumn[dense] = 0;
+    pool.frameWidth[dense] = 0;     // The whole patch, its width is known once it is compiled
+    pool.animation[dense] = SPRITE_ANIMATION_NONE;
+    pool.animationTime[dense] = 0;
+    pool.denseToSlot[dense] = slot;
+    pool.slotToDense[slot] = dense;
+
+    handle.slot = slot;
+    handle.generation = pool.slotGeneration[slot];
+    return handle;
+}
+
+/*
+ * Function: isSpriteAlive
+ * -------------------
+ * Checks whether a handle still refers to a sprite in the pool
+ * 
+ * sprite_handle_t handle: Handle returned by spawnSprite()
+ * 
+ * returns: true/false if the sprite is alive
+ */
+bool isSpriteAlive(sprite_handle_t handle) {
+    return handle.generation != 0
+        && handle.slot < (uint32_t)pool.numSlots
+        && pool.slotGeneration[handle.slot] == handle.generation;
+}
+
+/*
+ * Function: setSpriteAnimation
+ * -------------------
+ * Starts playing an animation on a sprite from its first frame
+ * 
+ * sprite_handle_t handle: Handle returned by spawnSprite()
+ * sprite_animation_t animation: Animation to play
+ * 
+ * returns: true/false if the sprite is alive and the animation valid
+ */
+bool setSpriteAnimation(sprite_handle_t handle, sprite_animation_t animation) {
+    if (!isSpriteAlive(handle) || animation <= SPRITE_ANIMATION_NONE || animation >= NUM_SPRITE_ANIMATIONS)
+        return false;
+
+    int dense = pool.slotToDense[handle.slot];
+    pool.textureIndex[dense] = animations[animation].textureIndex;
+    pool.frameColumn[dense] = animations[animation].frames[0] * animations[animation].frameWidth;
+    pool.frameWidth[dense] = animations[animation].frameWidth;
+    pool.animation[dense] = animation;
+    pool.animationTime[dense] = 0;
+    return true;
+}
+
+/*
+ * Function: spawnAnimatedSprite
+ * -------------------
+ * Adds a sprite to the pool playing an animation
+ * 
+ * float x: Horizontal coordinate
+ * float y: Vertical coordinate
+ * sprite_animation_t animation: Animation to play
+ * 
+ * returns: sprite_handle_t Handle to the sprite (see spawnSprite())
+ */
+sprite_handle_t spawnAnimatedSprite(float x, float y, sprite_animation_t animation) {
+    sprite_handle_t handle = { .slot = 0, .generation = 0 };
+    if (animation <= SPRITE_ANIMATION_NONE || animation >= NUM_SPRITE_ANIMATIONS)
+        return handle;
+    handle = spawnSprite(x, y, animations[animation].textureIndex);
+    setSpriteAnimation(handle, animation);
+    return handle;
+}
+
+/*
+ * Function: despawnSprite
+ * -------------------
+ * Removes a sprite from the pool. The last sprite is moved into the hole
+ * to keep the dense arrays packed. Visible lists refer to dense indices,
+ * so every view is empty until its next updateSpriteView().
+ * 
+ * sprite_handle_t handle: Handle returned by spawnSprite()
+ * 
+ * returns: true/false if the sprite was alive
+ */
+bool despawnSprite(sprite_handle_t handle) {
+    if (!isSpriteAlive(handle))
+        return false;
+
+    int dense = pool.slotToDense[handle.slot];
+    int last = --pool.count;
+    if (dense != last) {
+        pool.x[dense] = pool.x[last];
+        pool.y[dense] = pool.y[last];
+        pool.textureIndex[dense] = pool.textureIndex[last];
+        pool.frameColumn[dense] = pool.frameColumn[last];
+        pool.frameWidth[dense] = pool.frameWidth[last];
+        pool.animation[dense] = pool.animation[last];
+        pool.animationTime[dense] = pool.animationTime[last];
+        pool.denseToSlot[dense] = pool.denseToSlot[last];
+        pool.slotToDense[pool.denseToSlot[dense]] = dense;
+    }
+
+    // Bump the generation (skipping 0) so stale handles are rejected
+    if (++pool.slotGeneration[handle.slot] == 0)
+        pool.slotGeneration[handle.slot] = 1;
+    pool.freeSlots[pool.numFreeSlots++] = handle.slot;
+    pool.despawns++;
+    return true;
+}
+
+int getNumSprites(void) {
+    return pool.count;
+}
+
+int getNumVisibleSprites(void) {
+    const sprite_view_t* view = &getMainRenderContext()->sprites;
+    return view->despawns == pool.despawns ? view->numVisible : 0;
+}
+
+/*
+ * Function: depthSortKey
+ * -------------------
+ * Maps a distance onto an unsigned key that sorts far sprites first. The
+ * IEEE-754 bits of a non-negative float already order like the float, so
+ * inverting them gives a descending (back to front) order.
+ * 
+ * float distance: Distance from the player to the sprite
+ * 
+ * returns: uint32_t Sort key
+ */
+static uint32_t depthSortKey(float distance) {
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return ~bits;
+}
+
+/*
+ * Function: insertionSortPairs
+ * -------------------
+ * Sorts the pairs by key. It runs in O(n + inversions), which is close to
+ * linear when the input comes in the previous frame's order.
+ * 
+ * sprite_sort_pair_t* pairs: Pairs to sort in place
+ * int n: Number of pairs
  * 
  * returns: void
  */
-void drawSpriteProjection() {
-    sprite_t visibleSprites[NUM_SPRITES];
-    int numVisibleSprites = 0;
+static void insertionSortPairs(sprite_sort_pair_t* pairs, int n) {
+    for (int i = 1; i < n; i++) {
+        sprite_sort_pair_t pair = pairs[i];
+        int j = i - 1;
+        while (j >= 0 && pairs[j].key > pair.key) {
+            pairs[j + 1] = pairs[j];
+            j--;
+        }
+        pairs[j + 1] = pair;
+    }
+}
+
+/*
+ * Function: radixSortPairs
+ * -------------------
+ * Stable LSD radix sort of the pairs by key, one byte per pass. Passes
+ * where every key shares the same byte are skipped.
+ * 
+ * sprite_sort_pair_t* pairs: Pairs to sort, also receives the result
+ * sprite_sort_pair_t* scratch: Buffer with room for n pairs
+ * int n: Number of pairs
+ * 
+ * returns: void
+ */
+static void radixSortPairs(sprite_sort_pair_t* pairs, sprite_sort_pair_t* scratch, int n) {
+    if (n < 2)
+        return;
+
+    uint32_t histogram[4][256] = {{0}};
+    for (int i = 0; i < n; i++) {
+        uint32_t key = pairs[i].key;
+        histogram[0][key & 0xFF]++;
+        histogram[1][(key >> 8) & 0xFF]++;
+        histogram[2][(key >> 16) & 0xFF]++;
+        histogram[3][key >> 24]++;
+    }
+
+    sprite_sort_pair_t* src = pairs;
+    sprite_sort_pair_t* dst = scratch;
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = pass * 8;
+        if (histogram[pass][(src[0].key >> shift) & 0xFF] == (uint32_t)n)
+            continue;
+
+        uint32_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            uint32_t count = histogram[pass][digit];
+            histogram[pass][digit] = offset;
+            offset += count;
+        }
+        for (int i = 0; i < n; i++)
+            dst[histogram[pass][(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        sprite_sort_pair_t* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != pairs)
+        memcpy(pairs, src, sizeof(*pairs) * n);
+}
+
+/*
+ * Function: updateSprites
+ * -------------------
+ * Advances sprite animations, requests the textures of sprites near the
+ * player, and updates the sprites seen from the main render context
+ * 
+ * float dt: Delta time since the last loop iteration
+ * 
+ * returns: void
+ */
+void updateSprites(float dt) {
     struct Player player = getPlayer();
 
-    // Which sprites are visible?
-    for (int i = 0; i < NUM_SPRITES; i++) {
-        float angleSpritePlayer = player.rotationAngle - atan2(sprites[i].y - player.y, sprites[i].x - player.x);
+    // Advance animations. Only the frame column changes, the texture is shared.
+    for (int i = 0; i < pool.count; i++) {
+        int animation = pool.animation[i];
+        if (animation == SPRITE_ANIMATION_NONE)
+            continue;
+        pool.animationTime[i] += dt;
+        int frame = pool.animationTime[i] * animations[animation].framesPerSecond;
+        if (animations[animation].loop)
+            frame %= animations[animation].numFrames;
+        else if (frame >= animations[animation].numFrames)
+            frame = animations[animation].numFrames - 1;
+        pool.frameColumn[i] = animations[animation].frames[frame] * animations[animation].frameWidth;
+    }
+
+    // Have textures of nearby sprites decoded before they come into view
+    const float PREFETCH_DISTANCE = TEXTURE_PREFETCH_RADIUS * TILE_SIZE;
+    for (int i = 0; i < pool.count; i++) {
+        if (patches[pool.textureIndex[i]].width == 0
+            && fabs(pool.x[i] - player.x) < PREFETCH_DISTANCE && fabs(pool.y[i] - player.y) < PREFETCH_DISTANCE)
+            requestTexture(pool.textureIndex[i]);
+    }
+
+    updateSpriteView(&getMainRenderContext()->sprites, player.x, player.y, player.rotationAngle);
+}
+
+/*
+ * Function: growSpriteView
+ * -------------------
+ * Resizes the arrays of a view to the capacity of the pool
+ * 
+ * sprite_view_t* view: View
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool growSpriteView(sprite_view_t* view) {
+#define GROW_VIEW_ARRAY(field) { \
+        void* resized = realloc(view->field, sizeof(*view->field) * pool.capacity); \
+        if (resized == NULL) { \
+            fprintf(stderr, "Error growing a sprite view to %d sprites.\n", pool.capacity); \
+            return false; \
+        } \
+        view->field = resized; \
+    }
+    SPRITE_VIEW_ARRAYS(GROW_VIEW_ARRAY)
+#undef GROW_VIEW_ARRAY
+    // New sprites must not look visible in the current frame
+    memset(view->visibleFrame + view->capacity, 0, sizeof(*view->visibleFrame) * (pool.capacity - view->capacity));
+    view->capacity = pool.capacity;
+    return true;
+}
+
+void freeSpriteView(sprite_view_t* view) {
+#define FREE_VIEW_ARRAY(field) free(view->field);
+    SPRITE_VIEW_ARRAYS(FREE_VIEW_ARRAY)
+#undef FREE_VIEW_ARRAY
+    memset(view, 0, sizeof(*view));
+}
+
+/*
+ * Function: updateSpriteView
+ * -------------------
+ * Finds the sprites that fall under the FoV of a camera, stores their
+ * angle and distance, and sorts their dense indices back to front
+ * (painter's algorithm) for drawSpriteView(). The pool is only read, so
+ * views of different cameras can be updated at once.
+ * 
+ * The order barely changes between frames, so small lists are built in
+ * last frame's order and insertion sorted. Large lists are radix sorted.
+ * 
+ * sprite_view_t* view: View to update
+ * float x: Horizontal coordinate of the camera
+ * float y: Vertical coordinate of the camera
+ * float angle: Camera direction
+ * 
+ * returns: void
+ */
+void updateSpriteView(sprite_view_t* view, float x, float y, float angle) {
+    int numVisible = 0;
+
+    if (view->capacity < pool.capacity && !growSpriteView(view)) {
+        view->numVisible = 0;
+        return;
+    }
+    // After a despawn the last order no longer matches the dense indices
+    if (view->despawns != pool.despawns) {
+        view->numVisible = 0;
+        view->despawns = pool.despawns;
+    }
+
+    // Frame 0 is reserved for "not visible"
+    if (++view->frame == 0)
+        view->frame = 1;
+
+    for (int i = 0; i < pool.count; i++) {
+        float angleSpritePlayer = angle - atan2(pool.y[i] - y, pool.x[i] - x);
 
         // Make sure the angle is between 0 and 180 degrees
         if (angleSpritePlayer > PI)
@@ -74,66 +557,298 @@ void drawSpriteProjection() {
         // Which sprite are under our FoV
         const float EPSILON = 0.05;
         if (angleSpritePlayer < (FOV_ANGLE / 2) + EPSILON) {
-            sprites[i].visible = true;
-            sprites[i].angle = angleSpritePlayer;
-            sprites[i].distance = distanceBetweenPoints(sprites[i].x, sprites[i].y, player.x, player.y);
-            visibleSprites[numVisibleSprites] = sprites[i];
-            numVisibleSprites++;
-        } else {
-            sprites[i].visible = false;
+            view->angle[i] = angleSpritePlayer;
+            view->distance[i] = distanceBetweenPoints(pool.x[i], pool.y[i], x, y);
+            view->visibleFrame[i] = view->frame;
+            numVisible++;
         }
     }
 
-    // bubble-sort sprites by distance (back from front - painter's algorithm)
-    for (int i = 0; i < numVisibleSprites - 1; i++) {
-        for (int j = i + 1; j < numVisibleSprites; j++) {
-            if (visibleSprites[i].distance < visibleSprites[j].distance) {
-                sprite_t tmp = visibleSprites[i];
-                visibleSprites[i] = visibleSprites[j];
-                visibleSprites[j] = tmp;
+    sprite_sort_pair_t* pairs = view->sortPairs;
+    int n = 0;
+    if (numVisible < SPRITE_RADIX_SORT_THRESHOLD) {
+        // Sprites still visible go first, in the order of the last frame.
+        // Clearing their mark keeps them from being added twice below.
+        for (int k = 0; k < view->numVisible; k++) {
+            int i = view->visible[k];
+            if (view->visibleFrame[i] == view->frame) {
+                pairs[n].key = depthSortKey(view->distance[i]);
+                pairs[n].index = i;
+                view->visibleFrame[i] = 0;
+                n++;
             }
         }
     }
+    for (int i = 0; i < pool.count && n < numVisible; i++) {
+        if (view->visibleFrame[i] == view->frame) {
+            pairs[n].key = depthSortKey(view->distance[i]);
+            pairs[n].index = i;
+            n++;
+        }
+    }
 
-    // Draw the visible sprite
-    for (int i = 0; i < numVisibleSprites; i++) {
-        sprite_t sprite = visibleSprites[i];
-        float perpDistance = sprite.distance * cos(sprite.angle);
-        float spriteHeight = ((float)TILE_SIZE / perpDistance) * DIST_PROJ_PLANE;
-        float spriteWidth = spriteHeight;
+    if (numVisible < SPRITE_RADIX_SORT_THRESHOLD)
+        insertionSortPairs(pairs, n);
+    else
+        radixSortPairs(pairs, view->sortScratch, n);
+
+    for (int k = 0; k < n; k++)
+        view->visible[k] = pairs[k].index;
+    view->numVisible = n;
+}
+
+/*
+ * Function: prepareSpriteView
+ * -------------------
+ * Compiles the patches of the sprites in a view, so drawing the view
+ * only reads them
+ * 
+ * const sprite_view_t* view: View, updated
+ * 
+ * returns: void
+ */
+void prepareSpriteView(const sprite_view_t* view) {
+    if (view->despawns != pool.despawns)
+        return;
+    for (int k = 0; k < view->numVisible; k++)
+        getSpritePatch(pool.textureIndex[view->visible[k]]);
+}
+
+/*
+ * Function: drawSpritesInMiniMap
+ * -------------------
+ * Draw a small square in the minimap for every sprite
+ * 
+ * returns: void
+ */
+void drawSpritesInMiniMap() {
+    drawSpriteViewInMiniMap(getMainRenderContext());
+}
+
+/*
+ * Function: drawSpriteViewInMiniMap
+ * -------------------
+ * Draw a small square for every sprite in the minimap of a context
+ * 
+ * render_context_t* context: Context, with its minimap view placed
+ * 
+ * returns: void
+ */
+void drawSpriteViewInMiniMap(render_context_t* context) {
+    for (int i = 0; i < pool.count; i++) {
+        float x, y;
+        worldToMiniMap(context, pool.x[i], pool.y[i], &x, &y);
+        drawViewRect(
+            context,
+            x,
+            y,
+            5,
+            5,
+            0xFFFF0000
+        );
+    }
+}
+
+/*
+ * Function: drawSpriteColumns
+ * -------------------
+ * Rasterizes a sprite column by column into the frame of a context. The sprite rectangle is clipped
+ * against the screen once, columns hidden behind a closer wall are skipped
+ * before any texel is read, and only the opaque runs of the patch are
+ * drawn, stepping texture coordinates in 16.16 fixed point. The cost
+ * follows the visible opaque pixels of the sprite.
+ * 
+ * render_context_t* context: Context, its rays give the wall distances
+ * const patch_t* patch: Sprite texture compiled into opaque runs
+ * int firstColumn: First patch column of the frame to draw
+ * int frameWidth: Number of patch columns in the frame
+ * float left: Unclipped left edge of the sprite on the screen
+ * float top: Unclipped top edge of the sprite on the screen
+ * float width: Projected width in pixels
+ * float height: Projected height in pixels
+ * float distance: Distance from the player to the sprite
+ * uint64_t (*coverage)[SPRITE_COVERAGE_WORDS]: Coverage mask for front to back
+ * rendering, pixels already set are skipped. NULL to draw every pixel.
+ * 
+ * returns: void
+ */
+static void drawSpriteColumns(render_context_t* context, const patch_t* patch, int firstColumn, int frameWidth, float left, float top, float width, float height, float distance, uint64_t (*coverage)[SPRITE_COVERAGE_WORDS]) {
+    uint32_t* colorBuffer = context->colorBuffer;
+    // Palettized mode draws the palette indices of the patch instead
+    uint8_t* indexBuffer = isPalettizedMode() ? context->indexBuffer : NULL;
+    sprite_render_stats_t* renderStats = &context->sprites.renderStats;
+
+    // Clip against the screen: pixel centers inside [left, left + width)
+    // (clamped as floats, huge projections of close sprites don't fit an int)
+    int x0 = (int)fmax(ceil(left), 0);
+    int x1 = (int)fmin(ceil(left + width), context->width);
+    int y0 = (int)fmax(ceil(top), 0);
+    int y1 = (int)fmin(ceil(top + height), context->height);
+    if (patch->width == 0 || frameWidth <= 0 || x0 >= x1 || y0 >= y1 || (indexBuffer != NULL && patch->indices == NULL))
+        return;
 
-        // Sprite top Y
-        float spriteTopY = (WINDOW_HEIGHT/2) - (spriteHeight/2);
-        spriteTopY = (spriteTopY < 0) ? 0 : spriteTopY;
-
-        // Sprite bottom Y
-        float spriteBottomY = (WINDOW_HEIGHT/2) + (spriteHeight/2);
-        spriteBottomY = (spriteBottomY > WINDOW_HEIGHT) ? WINDOW_HEIGHT : spriteBottomY;
-
-        // Sprite X position
-        float spriteAngle = atan2(sprite.y - player.y, sprite.x - player.x) - player.rotationAngle;
-        float spritePosX = tan(spriteAngle) * DIST_PROJ_PLANE;
-        float spriteLeftX = (WINDOW_WIDTH / 2) + spritePosX - (spriteWidth / 2);
-        float spriteRightX = spriteLeftX + spriteWidth;
-
-        // Query the texture
-        int textureWidth = upng_get_width(textures[sprite.textureIndex]);
-        int textureHeight = upng_get_height(textures[sprite.textureIndex]);
-
-        // Draw on the screen
-        for (int x = spriteLeftX; x < spriteRightX; x++) {
-            float pixelWidth = textureWidth / spriteWidth;
-            int textureOffsetX = (x - spriteLeftX) * pixelWidth;
-            for (int y = spriteTopY; y < spriteBottomY; y++) {
-                if (x > 0 && x < WINDOW_WIDTH && y > 0 && y < WINDOW_HEIGHT) {
-                    int distanceFromTop = y + (spriteHeight / 2) - (WINDOW_HEIGHT/2);
-                    int textureOffsetY = distanceFromTop * (textureHeight / spriteHeight);
-                    uint32_t* spriteTextureBuffer = (uint32_t*)upng_get_buffer(textures[sprite.textureIndex]);
-                    uint32_t color = spriteTextureBuffer[(textureWidth * textureOffsetY) + textureOffsetX];
-                    if(sprite.distance < getRayWallHitDistance(x) && color != 0xFF880098) // Our transparency color
-                        draw_pixel(x, y, color);
+    // Texture steps per screen pixel, and the coordinates of the first pixel
+    int32_t uStep = (int32_t)((float)frameWidth / width * 65536);
+    int32_t vStep = (int32_t)fmax((float)patch->height / height * 65536, 1);
+    int32_t u = (int32_t)((x0 - left) * frameWidth / width * 65536);
+    int32_t v0 = (int32_t)((y0 - top) * patch->height / height * 65536);
+    int32_t uMax = (frameWidth << 16) - 1;
+
+    for (int x = x0; x < x1; x++, u += uStep) {
+        // The wall in this column is in front of the sprite
+        if (context->rays[x].distance <= distance)
+            continue;
+
+        int column = firstColumn + ((u > uMax ? uMax : u) >> 16);
+        const patch_span_t* span = patch->spans + patch->columns[column];
+        const patch_span_t* lastSpan = patch->spans + patch->columns[column + 1];
+        for (; span < lastSpan; span++) {
+            // Screen rows whose stepped v falls inside the run
+            int64_t runStart = ((int64_t)span->top << 16) - v0;
+            int64_t runEnd = ((int64_t)(span->top + span->length) << 16) - v0;
+            int64_t spanY0 = y0 + (runStart > 0 ? (runStart + vStep - 1) / vStep : 0);
+            int64_t spanY1 = y0 + (runEnd > 0 ? (runEnd + vStep - 1) / vStep : 0);
+            spanY1 = spanY1 > y1 ? y1 : spanY1;
+            if (spanY0 >= spanY1)
+                continue;
+
+            const uint32_t* texels = patch->texels + span->offset - span->top;
+            const uint8_t* indices = indexBuffer != NULL ? patch->indices + span->offset - span->top : NULL;
+            int32_t v = v0 + (spanY0 - y0) * vStep;
+            int pixel = (context->width * spanY0) + x;
+            if (coverage == NULL) {
+                if (indexBuffer != NULL) {
+                    for (int y = (int)spanY0; y < spanY1; y++, v += vStep, pixel += context->width)
+                        indexBuffer[pixel] = indices[v >> 16];
+                } else {
+                    for (int y = (int)spanY0; y < spanY1; y++, v += vStep, pixel += context->width)
+                        colorBuffer[pixel] = texels[v >> 16];
                 }
+                renderStats->pixelsDrawn += spanY1 - spanY0;
+                continue;
+            }
+
+            // Front to back: closer sprites own the pixels they already drew
+            uint64_t* column = coverage[x];
+            for (int y = (int)spanY0; y < spanY1; y++, v += vStep, pixel += context->width) {
+                uint64_t bit = (uint64_t)1 << (y & 63);
+                if (column[y >> 6] & bit) {
+                    renderStats->pixelsSkipped++;
+                    continue;
+                }
+                column[y >> 6] |= bit;
+                if (indexBuffer != NULL)
+                    indexBuffer[pixel] = indices[v >> 16];
+                else
+                    colorBuffer[pixel] = texels[v >> 16];
+                renderStats->pixelsDrawn++;
             }
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Function: setSpriteRenderMode
+ * -------------------
+ * Chooses how drawSpriteProjection() resolves overlapping sprites.
+ * Back to front paints far sprites first and lets near ones overdraw them
+ * (painter's algorithm). Front to back paints near sprites first and keeps
+ * a coverage mask, so hidden pixels are never fetched nor written. Both
+ * produce the same image.
+ * 
+ * sprite_render_mode_t mode: Rendering order
+ * 
+ * returns: void
+ */
+void setSpriteRenderMode(sprite_render_mode_t mode) {
+    renderMode = mode;
+}
+
+sprite_render_mode_t getSpriteRenderMode(void) {
+    return renderMode;
+}
+
+/*
+ * Function: getSpriteRenderStats
+ * -------------------
+ * Returns the pixel counts of the last drawSpriteProjection(). The
+ * overdraw factor is (drawn + skipped) / drawn: how many times the
+ * painter's algorithm would write each sprite pixel. It is only measured
+ * in front to back mode; back to front reports no skipped pixels.
+ * 
+ * returns: sprite_render_stats_t Pixel counts and overdraw factor
+ */
+sprite_render_stats_t getSpriteRenderStats(void) {
+    sprite_render_stats_t stats = getMainRenderContext()->sprites.renderStats;
+    stats.overdrawFactor = stats.pixelsDrawn > 0
+        ? (float)(stats.pixelsDrawn + stats.pixelsSkipped) / stats.pixelsDrawn
+        : 1.0f;
+    return stats;
+}
+
+/*
+ * Function: drawSpriteProjection
+ * -------------------
+ * Draw the sprites projection on the screen for sprites that are visible
+ * from the main render context
+ * 
+ * returns: void
+ */
+void drawSpriteProjection() {
+    render_context_t* context = getMainRenderContext();
+    prepareSpriteView(&context->sprites);
+    drawSpriteView(context);
+}
+
+/*
+ * Function: drawSpriteView
+ * -------------------
+ * Draw the sprites visible from a context, in the order chosen with
+ * setSpriteRenderMode(). Patches are only read: prepareSpriteView() must
+ * have compiled them.
+ * 
+ * render_context_t* context: Context, with its sprite view updated
+ * 
+ * returns: void
+ */
+void drawSpriteView(render_context_t* context) {
+    sprite_view_t* view = &context->sprites;
+    const int* visibleSprites = view->visible;
+    int numVisibleSprites = view->despawns == pool.despawns ? view->numVisible : 0;
+    bool frontToBack = renderMode == SPRITE_RENDER_FRONT_TO_BACK;
+    double distProjPlane = DIST_PROJ_PLANE_FOR(context->width);
+
+    memset(&view->renderStats, 0, sizeof(view->renderStats));
+    if (frontToBack)
+        memset(view->coverageMask, 0, sizeof(view->coverageMask[0]) * context->width);
+
+    // The visible sprites are already sorted back to front by updateSpriteView()
+    for (int i = 0; i < numVisibleSprites; i++) {
+        int sprite = visibleSprites[frontToBack ? numVisibleSprites - 1 - i : i];
+        float spriteDistance = view->distance[sprite];
+        int spriteTexture = pool.textureIndex[sprite];
+        float perpDistance = spriteDistance * cos(view->angle[sprite]);
+        float spriteHeight = ((float)TILE_SIZE / perpDistance) * distProjPlane;
+        float spriteWidth = spriteHeight;
+
+        // Unclipped sprite rectangle on the screen
+        float spriteTopY = (context->height/2) - (spriteHeight/2);
+        float spriteAngle = atan2(pool.y[sprite] - context->y, pool.x[sprite] - context->x) - context->angle;
+        float spritePosX = tan(spriteAngle) * distProjPlane;
+        float spriteLeftX = (context->width / 2) + spritePosX - (spriteWidth / 2);
+
+        const patch_t* patch = &patches[spriteTexture];
+        drawSpriteColumns(
+            context,
+            patch,
+            pool.frameColumn[sprite],
+            pool.frameWidth[sprite] > 0 ? pool.frameWidth[sprite] : patch->width,
+            spriteLeftX,
+            spriteTopY,
+            spriteWidth,
+            spriteHeight,
+            spriteDistance,
+            frontToBack ? view->coverageMask : NULL
+        );
+    }
+}
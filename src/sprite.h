@@ -1,21 +1,97 @@
 #ifndef SPRITE_H
 #define SPRITE_H
 
-#define NUM_SPRITES 5
+#include <stdbool.h>
+#include <stdint.h>
+#include "app.h"
 
+#define SPRITE_POOL_INITIAL_CAPACITY 64
+// Texels of this color are not drawn
+#define SPRITE_TRANSPARENT_COLOR 0xFF880098
+// Visible lists at least this long are radix sorted instead of insertion sorted
+#define SPRITE_RADIX_SORT_THRESHOLD 256
+// Front to back rendering: one bit per screen pixel already covered by a
+// closer sprite, column-major so a sprite column reads consecutive words
+#define SPRITE_COVERAGE_WORDS ((WINDOW_HEIGHT + 63) / 64)
+
+// Stable reference to a sprite in the pool. The generation is bumped every
+// time a slot is recycled, so handles to despawned sprites never alias
+// newer sprites that reuse the same slot.
+typedef struct {
+    uint32_t slot;
+    uint32_t generation;
+} sprite_handle_t;
+
+// Animations played from texture atlases (see the animations table in sprite.c)
+typedef enum {
+    SPRITE_ANIMATION_NONE = 0,
+    SPRITE_ANIMATION_GUARD_WALK,
+    SPRITE_ANIMATION_GUARD_SHOOT,
+    SPRITE_ANIMATION_GUARD_DIE,
+    NUM_SPRITE_ANIMATIONS
+} sprite_animation_t;
+
+typedef enum {
+    SPRITE_RENDER_BACK_TO_FRONT,
+    SPRITE_RENDER_FRONT_TO_BACK
+} sprite_render_mode_t;
+
+typedef struct {
+    int pixelsDrawn;        // Sprite pixels written to the color buffer
+    int pixelsSkipped;      // Opaque sprite pixels hidden by closer sprites
+    float overdrawFactor;   // (pixelsDrawn + pixelsSkipped) / pixelsDrawn
+} sprite_render_stats_t;
+
+// Depth sort entry: an order-preserving integer key for the distance plus
+// the dense index of the sprite, so sorting never moves sprite data
+typedef struct {
+    uint32_t key;
+    uint32_t index;
+} sprite_sort_pair_t;
+
+// Sprites seen from one camera. The per-sprite arrays are indexed like the
+// dense pool arrays and grow with the pool.
 typedef struct {
-    int i;
-    int j;
-    float x;
-    float y;
-    float distance;
-    float angle;
-    bool visible;
-    int textureIndex;
-} sprite_t;
+    float* distance;
+    float* angle;
+    uint32_t* visibleFrame;
+
+    // Dense indices of the sprites in the FoV, sorted back to front by
+    // updateSpriteView(). The previous frame's order seeds the next sort.
+    int* visible;
+    int numVisible;
+    uint32_t frame;
+    uint32_t despawns;      // Despawns in the pool when the visible list was built
+    sprite_sort_pair_t* sortPairs;
+    sprite_sort_pair_t* sortScratch;
+    int capacity;
+
+    uint64_t coverageMask[WINDOW_WIDTH][SPRITE_COVERAGE_WORDS];
+    sprite_render_stats_t renderStats;
+} sprite_view_t;
+
+struct render_context;
 
+bool initSprites(int capacity);
 void loadSprites();
+void freeSprites();
+sprite_handle_t spawnSprite(float x, float y, int textureIndex);
+sprite_handle_t spawnAnimatedSprite(float x, float y, sprite_animation_t animation);
+bool setSpriteAnimation(sprite_handle_t handle, sprite_animation_t animation);
+bool despawnSprite(sprite_handle_t handle);
+bool isSpriteAlive(sprite_handle_t handle);
+int getNumSprites(void);
+int getNumVisibleSprites(void);
+void updateSprites(float dt);
+void updateSpriteView(sprite_view_t* view, float x, float y, float angle);
+void prepareSpriteView(const sprite_view_t* view);
+void freeSpriteView(sprite_view_t* view);
 void drawSpritesInMiniMap(void);
+void drawSpriteViewInMiniMap(struct render_context* context);
+void setSpriteRenderMode(sprite_render_mode_t mode);
+sprite_render_mode_t getSpriteRenderMode(void);
+sprite_render_stats_t getSpriteRenderStats(void);
 void drawSpriteProjection(void);
+void drawSpriteView(struct render_context* context);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mapfile.h"
+#include "texturecache.h"
+
+// Cache file layout:
+//   texture_cache_header_t
+//   texture_cache_entry_t[numEntries]
+//   pixels of every entry, each one starting on a TEXTURE_CACHE_ALIGNMENT boundary
+// Pixels are stored exactly as the renderer reads them (32-bit RGBA texels,
+// row-major), so a cache hit is a pointer into the mapped file.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t reserved;
+} texture_cache_header_t;
+
+typedef struct {
+    char path[TEXTURE_CACHE_PATH_LENGTH];   // Source PNG path or pack asset name, the lookup key
+    uint64_t sourceSize;                    // Source size and mtime when it was decoded,
+    int64_t sourceMtime;                    // an entry is stale if either one changed
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;                        // Pixels offset from the start of the file
+} texture_cache_entry_t;
+
+static const char TEXTURE_CACHE_MAGIC[4] = { 'R', 'C', 'T', 'C' };
+
+static mapped_file_t cacheFile;
+static const texture_cache_entry_t* cacheEntries;
+static uint32_t numCacheEntries;
+
+/*
+ * Function: openTextureCache
+ * -------------------
+ * Maps the cache file and validates its header and entry table
+ * 
+ * const char* cachePath: Cache file path
+ * 
+ * returns: true/false if there is a usable cache
+ */
+bool openTextureCache(const char* cachePath) {
+    closeTextureCache();
+    if (!mapFile(cachePath, &cacheFile))
+        return false;
+
+    const texture_cache_header_t* header = (const texture_cache_header_t*)cacheFile.data;
+    if (cacheFile.size < sizeof(*header)
+        || memcmp(header->magic, TEXTURE_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != TEXTURE_CACHE_VERSION
+        || header->numEntries > (cacheFile.size - sizeof(*header)) / sizeof(texture_cache_entry_t)) {
+        closeTextureCache();
+        return false;
+    }
+
+    cacheEntries = (const texture_cache_entry_t*)(cacheFile.data + sizeof(*header));
+    numCacheEntries = header->numEntries;
+    return true;
+}
+
+/*
+ * Function: findCachedTexture
+ * -------------------
+ * Looks a texture up by its source path. The entry is only used when the
+ * source still has the size and mtime it had when it was cached.
+ * 
+ * const char* path: Source PNG path
+ * uint64_t sourceSize: Current size of the source
+ * int64_t sourceMtime: Current modification time of the source
+ * int* width: Receives the texture width
+ * int* height: Receives the texture height
+ * 
+ * returns: const uint32_t* Pixels inside the mapped cache, NULL on a miss
+ */
+const uint32_t* findCachedTexture(const char* path, uint64_t sourceSize, int64_t sourceMtime, int* width, int* height) {
+    if (numCacheEntries == 0)
+        return NULL;
+
+    for (uint32_t i = 0; i < numCacheEntries; i++) {
+        const texture_cache_entry_t* entry = &cacheEntries[i];
+        if (strncmp(entry->path, path, TEXTURE_CACHE_PATH_LENGTH) != 0)
+            continue;
+        if (entry->sourceSize != sourceSize || entry->sourceMtime != sourceMtime)
+            return NULL;
+
+        uint64_t numBytes = (uint64_t)entry->width * entry->height * sizeof(uint32_t);
+        if (entry->offset % TEXTURE_CACHE_ALIGNMENT != 0
+            || entry->offset > cacheFile.size
+            || numBytes > cacheFile.size - entry->offset)
+            return NULL;
+
+        *width = entry->width;
+        *height = entry->height;
+        return (const uint32_t*)(cacheFile.data + entry->offset);
+    }
+    return NULL;
+}
+
+/*
+ * Function: writePadding
+ * -------------------
+ * Writes zeros until the file position is a multiple of the alignment
+ * 
+ * FILE* file: File being written
+ * uint64_t* position: Current position, updated
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool writePadding(FILE* file, uint64_t* position) {
+    static const unsigned char zeros[TEXTURE_CACHE_ALIGNMENT] = { 0 };
+    size_t padding = (TEXTURE_CACHE_ALIGNMENT - *position % TEXTURE_CACHE_ALIGNMENT) % TEXTURE_CACHE_ALIGNMENT;
+    *position += padding;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+/*
+ * Function: saveTextureCache
+ * -------------------
+ * Writes a new cache holding the given textures. It is written to a
+ * temporary file first and renamed over the old cache once complete, so
+ * an interrupted write never leaves a broken cache behind. Textures
+ * currently pointing into the mapped cache stay valid: the mapping keeps
+ * the old file contents alive until closeTextureCache().
+ * 
+ * const char* cachePath: Cache file path
+ * const texture_cache_item_t* items: Decoded textures
+ * int numItems: Number of textures
+ * 
+ * returns: true/false if the operation succeeded
+ */
+bool saveTextureCache(const char* cachePath, const texture_cache_item_t* items, int numItems) {
+    char tmpPath[TEXTURE_CACHE_PATH_LENGTH + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", cachePath);
+
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating texture cache %s\n", tmpPath);
+        return false;
+    }
+
+    texture_cache_header_t header = { .version = TEXTURE_CACHE_VERSION };
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+    for (int i = 0; i < numItems; i++)
+        header.numEntries += items[i].pixels != NULL;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // Entry table, with every pixel block placed on the next aligned offset
+    uint64_t offset = sizeof(header) + (uint64_t)header.numEntries * sizeof(texture_cache_entry_t);
+    for (int i = 0; i < numItems && ok; i++) {
+        texture_cache_entry_t entry;
+        if (items[i].pixels == NULL)
+            continue;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.path, items[i].path, TEXTURE_CACHE_PATH_LENGTH - 1);
+        entry.sourceSize = items[i].sourceSize;
+        entry.sourceMtime = items[i].sourceMtime;
+        entry.width = items[i].width;
+        entry.height = items[i].height;
+        offset += (TEXTURE_CACHE_ALIGNMENT - offset % TEXTURE_CACHE_ALIGNMENT) % TEXTURE_CACHE_ALIGNMENT;
+        entry.offset = offset;
+        offset += (uint64_t)entry.width * entry.height * sizeof(uint32_t);
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+
+    uint64_t position = sizeof(header) + (uint64_t)header.numEntries * sizeof(texture_cache_entry_t);
+    for (int i = 0; i < numItems && ok; i++) {
+        if (items[i].pixels == NULL)
+            continue;
+        size_t numTexels = (size_t)items[i].width * items[i].height;
+        ok = writePadding(file, &position)
+            && fwrite(items[i].pixels, sizeof(uint32_t), numTexels, file) == numTexels;
+        position += numTexels * sizeof(uint32_t);
+    }
+
+    ok = fclose(file) == 0 && ok;
+    remove(cachePath);
+    if (!ok || rename(tmpPath, cachePath) != 0) {
+        fprintf(stderr, "Error writing texture cache %s\n", cachePath);
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Function: closeTextureCache
+ * -------------------
+ * Unmaps the cache. Pixels returned by findCachedTexture() are invalid
+ * afterwards.
+ * 
+ * returns: void
+ */
+void closeTextureCache(void) {
+    unmapFile(&cacheFile);
+    cacheEntries = NULL;
+    numCacheEntries = 0;
+}
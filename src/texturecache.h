@@ -0,0 +1,27 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TEXTURE_CACHE_FILE "./assets/textures.cache"
+#define TEXTURE_CACHE_VERSION 1
+#define TEXTURE_CACHE_PATH_LENGTH 256
+#define TEXTURE_CACHE_ALIGNMENT 64
+
+// Decoded texture handed to saveTextureCache()
+typedef struct {
+    const char* path;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    int width;
+    int height;
+    const uint32_t* pixels;
+} texture_cache_item_t;
+
+bool openTextureCache(const char* cachePath);
+const uint32_t* findCachedTexture(const char* path, uint64_t sourceSize, int64_t sourceMtime, int* width, int* height);
+bool saveTextureCache(const char* cachePath, const texture_cache_item_t* items, int numItems);
+void closeTextureCache(void);
+
+#endif
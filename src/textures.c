@@ -1,5 +1,16 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "arena.h"
+#include "assetpack.h"
+#include "embeddedtextures.h"
+#include "map.h"
+#include "mapfile.h"
+#include "palette.h"
+#include "texturecache.h"
 #include "textures.h"
+#include "upng.h"
 
 static const char* textureFileNames[NUM_TEXTURES] = {
     "./assets/wall-stone.png",
@@ -10,41 +21,620 @@ static const char* textureFileNames[NUM_TEXTURES] = {
     "./assets/barrel.png",
     "./assets/bones.png",
     "./assets/hanged.png",
+    "./assets/guard-spritesheet.png",
 };
 
+// Where the PNG bytes of a texture come from: a blob of the asset pack,
+// or the file itself when there is no pack or it lacks the texture
+typedef struct {
+    const unsigned char* data;      // Inside the mapped pack, NULL to read the file
+    size_t size;
+    uint64_t sourceSize;            // Texture cache key: size and mtime of the file or the pack
+    int64_t sourceMtime;
+} texture_source_t;
+
+// Texture decoding jobs (indices of textures to make resident), shared
+// by the loader threads. Every thread decodes with its own scratch arena,
+// reset between textures and kept for the next jobs.
+static struct {
+    texture_source_t sources[NUM_TEXTURES];
+    bool found[NUM_TEXTURES];       // The texture exists in the pack or on disk
+    int jobs[NUM_TEXTURES];
+    int numJobs;
+    SDL_atomic_t nextJob;
+    upng_error errors[NUM_TEXTURES];
+    arena_t arenas[TEXTURE_LOADER_MAX_THREADS];    // Arena 0 is the calling thread's
+    SDL_SpinLock atlasLock;         // Held while a loader thread copies to the atlas
+} loader;
+
+// Texture atlas: one aligned block holding the texels of every decoded
+// texture at the offsets of their descriptors. Space of evicted textures
+// is reclaimed by compacting the atlas when a new texture doesn't fit.
+static struct {
+    unsigned char* block;           // As returned by malloc()
+    unsigned char* base;            // First TEXTURE_ATLAS_ALIGNMENT boundary of the block
+    size_t capacity;
+    size_t used;                    // Next free offset
+} atlas;
+
+// Residency bookkeeping, only touched by the main thread
+static struct {
+    uint32_t frame;
+    uint32_t lastUsed[NUM_TEXTURES];    // Frame of the last getTexture(), 0 if never
+    bool requested[NUM_TEXTURES];       // To be prefetched by updateTextureResidency()
+    bool failed[NUM_TEXTURES];          // Not retried after an error
+    bool decoded[NUM_TEXTURES];         // Decoded in this run, kept in the texture cache on exit
+    bool decodedAny;                    // The texture cache is stale
+    size_t budget;
+    texture_residency_stats_t stats;
+} residency = { .frame = 1, .budget = TEXTURE_MEMORY_BUDGET };
+
+// Returned for indices that are not a texture, e.g. rays that hit no wall
+static const texture_t noTexture;
+
+#ifndef EMBEDDED_ASSETS
+/*
+ * Function: findTextureSource
+ * -------------------
+ * Looks a texture up in the asset pack by its file name, falling back to
+ * the file on disk
+ * 
+ * int i: Texture index
+ * texture_source_t* source: Receives where to read the texture from
+ * 
+ * returns: true/false if the texture exists in either place
+ */
+static bool findTextureSource(int i, texture_source_t* source) {
+    const char* name = strrchr(textureFileNames[i], '/');
+    int id = findAsset(name != NULL ? name + 1 : textureFileNames[i]);
+
+    memset(source, 0, sizeof(*source));
+    if (id >= 0 && getAssetType(id) == ASSET_IMAGE) {
+        source->data = getAssetData(id, &source->size);
+        return getAssetPackInfo(&source->sourceSize, &source->sourceMtime);
+    }
+    return getFileInfo(textureFileNames[i], &source->sourceSize, &source->sourceMtime);
+}
+#endif
+
+static size_t getAtlasSlotSize(int width, int height) {
+    size_t size = (size_t)width * height * sizeof(uint32_t);
+    return (size + TEXTURE_ATLAS_ALIGNMENT - 1) / TEXTURE_ATLAS_ALIGNMENT * TEXTURE_ATLAS_ALIGNMENT;
+}
+
+/*
+ * Function: reserveAtlasSpace
+ * -------------------
+ * Makes room for size more bytes at the end of the atlas. The textures in
+ * it are packed down in offset order, in place if that frees enough
+ * space, or into a new block at least twice as big otherwise. Their
+ * offsets and pixels are updated.
+ * 
+ * size_t size: Bytes needed, a multiple of TEXTURE_ATLAS_ALIGNMENT
+ * 
+ * returns: true/false if there is room
+ */
+static bool reserveAtlasSpace(size_t size) {
+    if (atlas.used + size <= atlas.capacity)
+        return true;
+
+    size_t liveBytes = 0;
+    for (int i = 0; i < NUM_TEXTURES; i++)
+        if (textures[i].storage == TEXTURE_IN_ATLAS)
+            liveBytes += getAtlasSlotSize(textures[i].width, textures[i].height);
+
+    unsigned char* block = atlas.block;
+    unsigned char* base = atlas.base;
+    size_t capacity = atlas.capacity;
+    if (liveBytes + size > capacity) {
+        capacity = capacity * 2 > liveBytes + size ? capacity * 2 : liveBytes + size;
+        block = malloc(capacity + TEXTURE_ATLAS_ALIGNMENT - 1);
+        if (block == NULL)
+            return false;
+        base = block + (TEXTURE_ATLAS_ALIGNMENT - (uintptr_t)block % TEXTURE_ATLAS_ALIGNMENT) % TEXTURE_ATLAS_ALIGNMENT;
+    }
+
+    // Lowest offset first, so moving down in place never overwrites a texture not moved yet
+    size_t offset = 0;
+    bool moved[NUM_TEXTURES] = { false };
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < NUM_TEXTURES; i++)
+            if (textures[i].storage == TEXTURE_IN_ATLAS && !moved[i] && (next < 0 || textures[i].offset < textures[next].offset))
+                next = i;
+        if (next < 0)
+            break;
+        size_t slotSize = getAtlasSlotSize(textures[next].width, textures[next].height);
+        memmove(base + offset, atlas.base + textures[next].offset, slotSize);
+        textures[next].offset = offset;
+        textures[next].pixels = (const uint32_t*)(base + offset);
+        moved[next] = true;
+        offset += slotSize;
+    }
+
+    if (block != atlas.block)
+        free(atlas.block);
+    atlas.block = block;
+    atlas.base = base;
+    atlas.capacity = capacity;
+    atlas.used = offset;
+    return true;
+}
+
+/*
+ * Function: storeTextureInAtlas
+ * -------------------
+ * Copies a decoded texture to the end of the atlas and points its
+ * descriptor at it
+ * 
+ * int i: Texture index
+ * upng_t* upng: Decoded texture, freed by the caller
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool storeTextureInAtlas(int i, upng_t* upng) {
+    int width = upng_get_width(upng);
+    int height = upng_get_height(upng);
+    size_t slotSize = getAtlasSlotSize(width, height);
+    if (!reserveAtlasSpace(slotSize))
+        return false;
+
+    memcpy(atlas.base + atlas.used, upng_get_buffer(upng), (size_t)width * height * sizeof(uint32_t));
+    textures[i].width = width;
+    textures[i].height = height;
+    textures[i].storage = TEXTURE_IN_ATLAS;
+    textures[i].offset = atlas.used;
+    textures[i].pixels = (const uint32_t*)(atlas.base + atlas.used);
+    atlas.used += slotSize;
+    return true;
+}
+
+static void* allocateScratch(void* arena, unsigned long size) {
+    return arenaAlloc(arena, size);
+}
+
+static void freeScratch(void* arena, void* ptr) {
+    arenaFree(arena, ptr);
+}
+
+/*
+ * Function: decodeTexture
+ * -------------------
+ * Loads and decodes one texture and copies it to the atlas. The PNG is
+ * decoded in place from the mapped asset pack, or from the texture file
+ * mapped for the duration of the decode; its compressed data is never
+ * copied. Every upng buffer comes from the scratch arena, which is reset
+ * afterwards.
+ * 
+ * int i: Texture index
+ * arena_t* arena: Scratch arena of the calling thread
+ * 
+ * returns: upng_error UPNG_EOK, or why the texture couldn't be decoded
+ */
+static upng_error decodeTexture(int i, arena_t* arena) {
+    const texture_source_t* source = &loader.sources[i];
+    const upng_allocator allocator = { allocateScratch, freeScratch, arena };
+    mapped_file_t file = { 0 };
+    const unsigned char* data = source->data;
+    size_t size = source->size;
+    if (data == NULL) {
+        if (!mapFile(textureFileNames[i], &file))
+            return UPNG_ENOTFOUND;
+        data = file.data;
+        size = file.size;
+    }
+
+    upng_t* upng = upng_new_from_bytes_with_allocator(data, size, &allocator);
+    if (upng == NULL) {
+        unmapFile(&file);
+        resetArena(arena);
+        return UPNG_ENOMEM;
+    }
+
+    upng_error error = upng_decode(upng);
+    if (error == UPNG_EOK) {
+        SDL_AtomicLock(&loader.atlasLock);
+        if (!storeTextureInAtlas(i, upng))
+            error = UPNG_ENOMEM;
+        SDL_AtomicUnlock(&loader.atlasLock);
+    }
+    upng_free(upng);
+    unmapFile(&file);
+    resetArena(arena);
+    return error;
+}
+
+/*
+ * Function: textureLoaderThread
+ * -------------------
+ * Worker of the loader pool: takes texture jobs until none are left.
+ * Every job only writes its own slot of loader.errors[], and textures[]
+ * while holding the atlas lock.
+ * 
+ * void* data: Scratch arena of the thread
+ * 
+ * returns: int 0
+ */
+static int textureLoaderThread(void* data) {
+    int job;
+    while ((job = SDL_AtomicAdd(&loader.nextJob, 1)) < loader.numJobs) {
+        int i = loader.jobs[job];
+        loader.errors[i] = decodeTexture(i, data);
+    }
+    return 0;
+}
+
+/*
+ * Function: runTextureJobs
+ * -------------------
+ * Decodes the queued texture jobs on a pool of threads (one per CPU, up
+ * to TEXTURE_LOADER_MAX_THREADS). The calling thread takes jobs too, so a
+ * single job or a single CPU starts no thread. Errors are reported once
+ * all the jobs have finished.
+ * 
+ * returns: void
+ */
+static void runTextureJobs() {
+    SDL_Thread* threads[TEXTURE_LOADER_MAX_THREADS];
+
+    int numThreads = SDL_GetCPUCount();
+    numThreads = numThreads > TEXTURE_LOADER_MAX_THREADS ? TEXTURE_LOADER_MAX_THREADS : numThreads;
+    numThreads = numThreads > loader.numJobs ? loader.numJobs : numThreads;
+
+    SDL_AtomicSet(&loader.nextJob, 0);
+
+    int numStarted = 0;
+    for (int i = 1; i < numThreads; i++) {
+        threads[numStarted] = SDL_CreateThread(textureLoaderThread, "TextureLoader", &loader.arenas[i]);
+        if (threads[numStarted] != NULL)
+            numStarted++;
+    }
+    textureLoaderThread(&loader.arenas[0]);
+    for (int i = 0; i < numStarted; i++)
+        SDL_WaitThread(threads[i], NULL);
+
+    for (int job = 0; job < loader.numJobs; job++) {
+        int i = loader.jobs[job];
+        if (loader.errors[i] == UPNG_ENOTFOUND || loader.errors[i] == UPNG_ENOMEM)
+            printf("Error loading texture file %s \n", textureFileNames[i]);
+        else if (loader.errors[i] != UPNG_EOK)
+            printf("Error decoding texture file %s \n", textureFileNames[i]);
+        residency.failed[i] = loader.errors[i] != UPNG_EOK;
+        residency.decoded[i] = residency.decoded[i] || loader.errors[i] == UPNG_EOK;
+        residency.decodedAny = residency.decodedAny || loader.errors[i] == UPNG_EOK;
+    }
+    loader.numJobs = 0;
+}
+
+#ifdef EMBEDDED_ASSETS
+/*
+ * Function: loadEmbeddedTextures
+ * -------------------
+ * Points every texture at its texels linked into the binary. No file is
+ * opened and nothing is decoded; the textures are always resident and
+ * never evicted, like the mapped ones.
+ * 
+ * returns: void
+ */
+static void loadEmbeddedTextures() {
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        const char* name = strrchr(textureFileNames[i], '/');
+        name = name != NULL ? name + 1 : textureFileNames[i];
+        memset(&textures[i], 0, sizeof(textures[i]));
+        for (int e = 0; e < numEmbeddedTextures; e++) {
+            if (strcmp(embeddedTextures[e].name, name) == 0) {
+                textures[i].width = embeddedTextures[e].width;
+                textures[i].height = embeddedTextures[e].height;
+                textures[i].pixels = embeddedTextures[e].pixels;
+                break;
+            }
+        }
+        if (textures[i].pixels != NULL)
+            textures[i].storage = TEXTURE_EMBEDDED;
+        else
+            printf("Texture %s is not embedded \n", textureFileNames[i]);
+        residency.failed[i] = textures[i].pixels == NULL;
+        residency.requested[i] = false;
+        residency.lastUsed[i] = 0;
+        residency.decoded[i] = false;
+    }
+    residency.decodedAny = false;
+}
+#endif
+
 /*
  * Function: loadTextures
  * -------------------
- * Load texture files from the disk to the textures array
+ * Prepares the textures for on-demand loading. Nothing is decoded here:
+ * textures found in the decoded texture cache, with the same source size
+ * and mtime, point straight into the mapped cache and are always
+ * resident. The rest are decoded the first time getTexture() asks for
+ * them, or earlier when prefetched by updateTextureResidency().
+ * Builds with EMBEDDED_ASSETS use the textures linked into the binary
+ * instead.
  * 
  * returns: void
  */
 void loadTextures() {
-    upng_t* upng;
+#ifdef EMBEDDED_ASSETS
+    loadEmbeddedTextures();
+#else
+    openAssetPack(ASSET_PACK_FILE);
+    openTextureCache(TEXTURE_CACHE_FILE);
+    loader.numJobs = 0;
     for (int i = 0; i < NUM_TEXTURES; i++) {
-        upng = upng_new_from_file(textureFileNames[i]);
-        if (upng != NULL) {
-            upng_decode(upng);
-            if (upng_get_error(upng) == UPNG_EOK) {
-                textures[i] = upng;
-            } else {
-                printf("Error decoding texture file %s \n", textureFileNames[i]);
-            }
-        } else {
+        texture_source_t* source = &loader.sources[i];
+        loader.errors[i] = UPNG_EOK;
+        memset(&textures[i], 0, sizeof(textures[i]));
+        loader.found[i] = findTextureSource(i, source);
+        if (loader.found[i]) {
+            textures[i].pixels = findCachedTexture(textureFileNames[i], source->sourceSize, source->sourceMtime,
+                &textures[i].width, &textures[i].height);
+            textures[i].storage = textures[i].pixels != NULL ? TEXTURE_MAPPED : TEXTURE_UNLOADED;
+        } else
             printf("Error loading texture file %s \n", textureFileNames[i]);
+        residency.failed[i] = !loader.found[i];
+        residency.requested[i] = false;
+        residency.lastUsed[i] = 0;
+        residency.decoded[i] = false;
+    }
+    residency.decodedAny = false;
+#endif
+}
+
+/*
+ * Function: getTexture
+ * -------------------
+ * Returns a texture for drawing, decoding it right away if it is not
+ * resident (a miss, which stalls the frame). In palettized mode its
+ * palette indices are also built the first time.
+ * 
+ * int i: Texture index
+ * 
+ * returns: const texture_t* The texture, its pixels are NULL if it failed to load
+ * or the index is not a texture
+ */
+const texture_t* getTexture(int i) {
+    if (i < 0 || i >= NUM_TEXTURES)
+        return &noTexture;
+    texture_t* texture = &textures[i];
+    if (residency.lastUsed[i] != residency.frame) {
+        residency.lastUsed[i] = residency.frame;
+        if (texture->pixels != NULL)
+            residency.stats.hits++;
+    }
+    if (texture->pixels == NULL && !residency.failed[i]) {
+        residency.stats.misses++;
+        loader.jobs[loader.numJobs++] = i;
+        runTextureJobs();
+    }
+    if (isPalettizedMode() && texture->pixels != NULL && texture->indices == NULL) {
+        texture->indices = malloc((size_t)texture->width * texture->height);
+        if (texture->indices != NULL)
+            quantizePixels(texture->pixels, texture->indices, texture->width, texture->height);
+    }
+    return texture;
+}
+
+/*
+ * Function: requestTexture
+ * -------------------
+ * Asks for a texture to be decoded by the next updateTextureResidency(),
+ * ahead of its first use
+ * 
+ * int i: Texture index
+ * 
+ * returns: void
+ */
+void requestTexture(int i) {
+    if (i >= 0 && i < NUM_TEXTURES && textures[i].pixels == NULL && !residency.failed[i])
+        residency.requested[i] = true;
+}
+
+/*
+ * Function: peekTexture
+ * -------------------
+ * Returns a texture as it is, without decoding it or counting the use.
+ * Safe from several threads while no texture is loaded or evicted.
+ * 
+ * int i: Texture index
+ * 
+ * returns: const texture_t* The texture, its pixels are NULL if it is not resident
+ * or the index is not a texture
+ */
+const texture_t* peekTexture(int i) {
+    if (i < 0 || i >= NUM_TEXTURES)
+        return &noTexture;
+    return &textures[i];
+}
+
+/*
+ * Function: getTextureHeapBytes
+ * -------------------
+ * Heap memory held by a texture: texels in the atlas and palette indices.
+ * Mapped and embedded texels are not counted.
+ * 
+ * int i: Texture index
+ * 
+ * returns: size_t Bytes
+ */
+static size_t getTextureHeapBytes(int i) {
+    size_t numTexels = (size_t)textures[i].width * textures[i].height;
+    return (textures[i].storage == TEXTURE_IN_ATLAS ? numTexels * sizeof(uint32_t) : 0)
+        + (textures[i].indices != NULL ? numTexels : 0);
+}
+
+/*
+ * Function: releaseTexture
+ * -------------------
+ * Frees the heap memory of a texture. Its atlas space is reclaimed by the
+ * next compaction. A mapped or embedded texture keeps its pixels and
+ * stays resident.
+ * 
+ * int i: Texture index
+ * 
+ * returns: void
+ */
+static void releaseTexture(int i) {
+    free(textures[i].indices);
+    textures[i].indices = NULL;
+    if (textures[i].storage == TEXTURE_IN_ATLAS)
+        memset(&textures[i], 0, sizeof(textures[i]));
+}
+
+/*
+ * Function: evictTextures
+ * -------------------
+ * Frees least recently used textures until their heap memory fits in the
+ * memory budget. Textures used in the current frame are kept even over
+ * budget.
+ * 
+ * returns: void
+ */
+static void evictTextures() {
+    size_t decodedBytes = 0;
+    for (int i = 0; i < NUM_TEXTURES; i++)
+        decodedBytes += getTextureHeapBytes(i);
+
+    while (decodedBytes > residency.budget) {
+        int victim = -1;
+        for (int i = 0; i < NUM_TEXTURES; i++) {
+            if (getTextureHeapBytes(i) == 0 || residency.lastUsed[i] == residency.frame)
+                continue;
+            if (victim < 0 || residency.lastUsed[i] < residency.lastUsed[victim])
+                victim = i;
         }
+        if (victim < 0)
+            break;
+
+        decodedBytes -= getTextureHeapBytes(victim);
+        releaseTexture(victim);
+        residency.stats.evicted++;
     }
 }
 
+/*
+ * Function: updateTextureResidency
+ * -------------------
+ * Runs once per frame: requests the wall textures of the tiles around a
+ * position, decodes every requested texture in one parallel batch, and
+ * evicts down to the memory budget
+ * 
+ * float x: Horizontal coordinate, usually the player's
+ * float y: Vertical coordinate
+ * 
+ * returns: void
+ */
+void updateTextureResidency(float x, float y) {
+    int row = (int)(y / TILE_SIZE);
+    int column = (int)(x / TILE_SIZE);
+    for (int i = row - TEXTURE_PREFETCH_RADIUS; i <= row + TEXTURE_PREFETCH_RADIUS; i++) {
+        for (int j = column - TEXTURE_PREFETCH_RADIUS; j <= column + TEXTURE_PREFETCH_RADIUS; j++) {
+            if (i < 0 || i >= MAP_NUM_ROWS || j < 0 || j >= MAP_NUM_COLS)
+                continue;
+            int content = getMapTileContent((j + 0.5f) * TILE_SIZE, (i + 0.5f) * TILE_SIZE);
+            if (content > 0 && content <= NUM_TEXTURES)
+                requestTexture(content - 1);
+        }
+    }
+
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        if (residency.requested[i] && textures[i].pixels == NULL && !residency.failed[i]) {
+            loader.jobs[loader.numJobs++] = i;
+            residency.lastUsed[i] = residency.frame;
+        }
+        residency.requested[i] = false;
+    }
+    residency.stats.prefetched += loader.numJobs;
+    if (loader.numJobs > 0)
+        runTextureJobs();
+
+    evictTextures();
+
+    // Frame 0 is reserved for "never used"
+    if (++residency.frame == 0)
+        residency.frame = 1;
+}
+
+/*
+ * Function: setTextureMemoryBudget
+ * -------------------
+ * Sets how many bytes of decoded texels to keep, enforced from the next
+ * updateTextureResidency()
+ * 
+ * size_t bytes: Budget in bytes
+ * 
+ * returns: void
+ */
+void setTextureMemoryBudget(size_t bytes) {
+    residency.budget = bytes;
+}
+
+texture_residency_stats_t getTextureResidencyStats(void) {
+    texture_residency_stats_t stats = residency.stats;
+    stats.budgetBytes = residency.budget;
+    stats.atlasBytes = atlas.capacity;
+    for (int i = 0; i < TEXTURE_LOADER_MAX_THREADS; i++) {
+        stats.decodeAllocations += loader.arenas[i].numAllocations;
+        stats.decodeHeapAllocations += loader.arenas[i].numHeapAllocations;
+        stats.scratchBytes += loader.arenas[i].capacity;
+    }
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        if (textures[i].pixels == NULL)
+            continue;
+        stats.numResident++;
+        stats.numMapped += textures[i].storage != TEXTURE_IN_ATLAS;
+        stats.decodedBytes += getTextureHeapBytes(i);
+    }
+    return stats;
+}
+
 /*
  * Function: freeTextures
  * -------------------
- * Free upng resources
+ * Rewrites the texture cache if anything was decoded in this run, then
+ * frees the atlas and the scratch arenas, and unmaps the texture cache
+ * and the asset pack.
+ * The new cache holds every texture decoded in this run (evicted ones are
+ * decoded again for it) and keeps the valid entries of the old cache for
+ * textures that are not resident, so it stops changing once every texture
+ * in use was decoded once.
  * 
  * returns: void
  */
 void freeTextures() {
+    if (residency.decodedAny) {
+        texture_cache_item_t items[NUM_TEXTURES];
+        for (int i = 0; i < NUM_TEXTURES; i++) {
+            if (residency.decoded[i] && textures[i].pixels == NULL && !residency.failed[i])
+                loader.jobs[loader.numJobs++] = i;
+        }
+        if (loader.numJobs > 0)
+            runTextureJobs();
+
+        for (int i = 0; i < NUM_TEXTURES; i++) {
+            items[i].path = textureFileNames[i];
+            items[i].sourceSize = loader.sources[i].sourceSize;
+            items[i].sourceMtime = loader.sources[i].sourceMtime;
+            items[i].width = textures[i].width;
+            items[i].height = textures[i].height;
+            items[i].pixels = textures[i].pixels;
+            if (items[i].pixels == NULL && loader.found[i])
+                items[i].pixels = findCachedTexture(textureFileNames[i], items[i].sourceSize, items[i].sourceMtime,
+                    &items[i].width, &items[i].height);
+        }
+        saveTextureCache(TEXTURE_CACHE_FILE, items, NUM_TEXTURES);
+        residency.decodedAny = false;
+    }
+
     for (int i = 0; i < NUM_TEXTURES; i++) {
-        upng_free(textures[i]);
+        releaseTexture(i);
+        memset(&textures[i], 0, sizeof(textures[i]));
     }
-}
\ No newline at end of file
+    free(atlas.block);
+    memset(&atlas, 0, sizeof(atlas));
+    for (int i = 0; i < TEXTURE_LOADER_MAX_THREADS; i++)
+        freeArena(&loader.arenas[i]);
+    closeTextureCache();
+    closeAssetPack();
+}
@@ -1,17 +1,66 @@
 #ifndef TEXTURES_H
 #define TEXTURES_H
+#include <stddef.h>
 #include <stdint.h>
 #include "app.h"
-#include "upng.h"
 
 // Textures
-#define NUM_TEXTURES 8
+#define NUM_TEXTURES 9
 #define TEXTURE_WIDTH 64
 #define TEXTURE_HEIGHT 64
+#define TEXTURE_LOADER_MAX_THREADS 16
+// Decoded textures are copied to offsets of the texture atlas aligned to this
+#define TEXTURE_ATLAS_ALIGNMENT 64
+// Decoded texels (and palette indices) kept in memory before least recently used textures are evicted
+#define TEXTURE_MEMORY_BUDGET (4 * 1024 * 1024)
+// Wall textures of the tiles this close to the player (in tiles) are decoded ahead of use
+#define TEXTURE_PREFETCH_RADIUS 3
 
-upng_t* textures[NUM_TEXTURES];
+// Where the texels of a resident texture live
+typedef enum {
+    TEXTURE_UNLOADED,
+    TEXTURE_IN_ATLAS,           // Decoded in this run and copied to the texture atlas
+    TEXTURE_MAPPED,             // Inside the mapped texture cache
+    TEXTURE_EMBEDDED            // Linked into the binary, builds with EMBEDDED_ASSETS
+} texture_storage_t;
+
+// Texture descriptor: 32-bit texels, row-major, width texels per row.
+// pixels is NULL while the texture is not resident. Atlas textures are
+// moved when the atlas is compacted or grown, so pixels is only valid
+// until the next getTexture() or updateTextureResidency().
+typedef struct {
+    int width;
+    int height;
+    const uint32_t* pixels;
+    uint8_t* indices;           // Palette indices, quantized on use in palettized mode
+    texture_storage_t storage;
+    size_t offset;              // Byte offset of the texels in the atlas, TEXTURE_IN_ATLAS only
+} texture_t;
+
+typedef struct {
+    int numResident;            // Textures with pixels in memory, decoded or mapped
+    int numMapped;              // Resident textures mapped from the texture cache or embedded, outside the atlas
+    size_t decodedBytes;        // Decoded texels and palette indices, held to the budget
+    size_t budgetBytes;
+    size_t atlasBytes;          // Capacity of the texture atlas
+    int decodeAllocations;      // Buffers requested by upng while decoding
+    int decodeHeapAllocations;  // Of those, and scratch arena growth, the ones that reached malloc()
+    size_t scratchBytes;        // Scratch arenas of the loader threads
+    int hits;                   // Frames in which a texture was used and already resident
+    int misses;                 // Textures decoded on use, stalling the frame
+    int prefetched;             // Textures decoded ahead of use
+    int evicted;
+} texture_residency_stats_t;
+
+texture_t textures[NUM_TEXTURES];
 
 void loadTextures();
 void freeTextures();
+const texture_t* getTexture(int i);
+const texture_t* peekTexture(int i);
+void requestTexture(int i);
+void updateTextureResidency(float x, float y);
+void setTextureMemoryBudget(size_t bytes);
+texture_residency_stats_t getTextureResidencyStats(void);
 
 #endif
\ No newline at end of file
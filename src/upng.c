@@ -28,16 +28,31 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "upng.h"
 
+/* SSE2 scanline unfiltering, compiled in for x86 and picked at runtime after a CPU check. Define UPNG_NO_SIMD to leave it out. */
+#if !defined(UPNG_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define UPNG_SSE2 1
+#define UPNG_TARGET_SSE2 __attribute__((target("sse2")))
+#include <emmintrin.h>
+#elif !defined(UPNG_NO_SIMD) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define UPNG_SSE2 1
+#define UPNG_TARGET_SSE2
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
+
 #define MAKE_BYTE(b) ((b) & 0xFF)
-#define MAKE_DWORD(a,b,c,d) ((MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
+#define MAKE_DWORD(a,b,c,d) (((unsigned long)MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
 #define MAKE_DWORD_PTR(p) MAKE_DWORD((p)[0], (p)[1], (p)[2], (p)[3])
 
 #define CHUNK_IHDR MAKE_DWORD('I','H','D','R')
 #define CHUNK_IDAT MAKE_DWORD('I','D','A','T')
 #define CHUNK_IEND MAKE_DWORD('I','E','N','D')
+#define CHUNK_PLTE MAKE_DWORD('P','L','T','E')
+#define CHUNK_TRNS MAKE_DWORD('t','R','N','S')
 
 #define FIRST_LENGTH_CODE_INDEX 257
 #define LAST_LENGTH_CODE_INDEX 285
@@ -45,19 +60,13 @@ freely, subject to the following restrictions:
 #define NUM_DEFLATE_CODE_SYMBOLS 288	/*256 literals, the end code, some length codes, and 2 unused codes */
 #define NUM_DISTANCE_SYMBOLS 32	/*the distance codes have their own symbols, 30 used, 2 unused */
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
-#define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
-
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
 #define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
 
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
+#define UPNG_ALLOC(upng,size) ((upng)->allocator.alloc((upng)->allocator.user, (size)))
+#define UPNG_FREE(upng,ptr) ((upng)->allocator.free((upng)->allocator.user, (void*)(ptr)))
+
 #define upng_chunk_length(chunk) MAKE_DWORD_PTR(chunk)
 #define upng_chunk_type(chunk) MAKE_DWORD_PTR((chunk) + 4)
 #define upng_chunk_critical(chunk) (((chunk)[4] & 32) == 0)
@@ -72,6 +81,7 @@ typedef enum upng_state {
 typedef enum upng_color {
 	UPNG_LUM		= 0,
 	UPNG_RGB		= 2,
+	UPNG_PAL		= 3,
 	UPNG_LUMA		= 4,
 	UPNG_RGBA		= 6
 } upng_color;
@@ -98,13 +108,12 @@ struct upng_t {
 
 	upng_state		state;
 	upng_source		source;
-};
 
-typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
-	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
+	unsigned char	palette[256 * 4];	/* RGBA entries from PLTE and tRNS */
+	unsigned		palette_size;
+
+	upng_allocator	allocator;
+};
 
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
 	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
@@ -129,506 +138,476 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
+/* bit reader over the zlib stream: bits are consumed LSB first from a 64-bit
+ * buffer which is refilled a whole word at a time while the input lasts. The
+ * stream is read in place from the payloads of the IDAT chunks, one segment
+ * at a time, so it is never concatenated */
+typedef struct bit_reader {
+	const unsigned char* in;	/* current segment: payload of an IDAT chunk */
+	unsigned long insize;
+	unsigned long pos;		/* next byte of "in" to load into the buffer */
+	const unsigned char* chunk;	/* chunk after the current segment */
+	const unsigned char* end;	/* end of the chunks */
+	uint64_t buf;			/* bits loaded but not consumed yet */
+	unsigned count;			/* number of valid bits in buf */
+	unsigned long padding;	/* zero bits loaded past the end of the last segment */
+} bit_reader;
+
+/* decoding table entry: for codes up to HUFFMAN_FAST_BITS the primary table
+ * holds (symbol << 8 | code length). Longer codes share a primary entry per
+ * HUFFMAN_FAST_BITS prefix which holds (subtable offset << 8 | HUFFMAN_SUBTABLE |
+ * subtable bits), and the subtable entry holds (symbol << 8 | code length).
+ * An entry with length 0 is not a valid code. */
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_FAST_MASK ((1u << HUFFMAN_FAST_BITS) - 1)
+#define HUFFMAN_SUBTABLE 0x80
+#define HUFFMAN_SUB_ENTRIES 960	/* enough for any complete deflate code, and for 30 distance codes of 15 bits */
+
+typedef struct huffman_table {
+	uint32_t fast[1 << HUFFMAN_FAST_BITS];
+	uint32_t sub[HUFFMAN_SUB_ENTRIES];
+} huffman_table;
+
+/* move to the payload of the next IDAT chunk; false when there is none. The
+ * chunks were validated by upng_decode before inflating */
+static int bits_next_segment(bit_reader* br)
+{
+	while (br->chunk < br->end) {
+		const unsigned char* chunk = br->chunk;
+		br->chunk += upng_chunk_length(chunk) + 12;
+		if (upng_chunk_type(chunk) == CHUNK_IEND) {
+			br->chunk = br->end;
+		} else if (upng_chunk_type(chunk) == CHUNK_IDAT && upng_chunk_length(chunk) > 0) {
+			br->in = chunk + 8;
+			br->insize = upng_chunk_length(chunk);
+			br->pos = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
 
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+/* start reading at the first IDAT chunk among the chunks in [chunk, end) */
+static void bits_init(bit_reader* br, const unsigned char* chunk, const unsigned char* end)
+{
+	br->in = NULL;
+	br->insize = 0;
+	br->pos = 0;
+	br->chunk = chunk;
+	br->end = end;
+	br->buf = 0;
+	br->count = 0;
+	br->padding = 0;
+	bits_next_segment(br);
+}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/* top the buffer up to at least 56 bits. Past the end of the last segment
+ * zeros are shifted in; bits_overrun() tells whether any of them were consumed */
+static void bits_refill(bit_reader* br)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	if (br->count >= 56) {
+		return;
+	}
+
+	if (br->pos + 8 <= br->insize) {
+		const unsigned char* p = br->in + br->pos;
+		uint64_t word = (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+			((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+		br->buf |= word << br->count;
+		br->pos += (63 - br->count) >> 3;
+		br->count |= 56;
+	} else {
+		/* the end of a segment: byte by byte, moving on to the next one */
+		while (br->count <= 56) {
+			uint64_t byte = 0;
+			if (br->pos < br->insize || bits_next_segment(br)) {
+				byte = br->in[br->pos++];
+			} else {
+				br->padding += 8;
+			}
+			br->buf |= byte << br->count;
+			br->count += 8;
+		}
+	}
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/* nbits must be at most the number of bits in the buffer */
+static unsigned bits_get(bit_reader* br, unsigned nbits)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
+	unsigned result = (unsigned)(br->buf & ((1u << nbits) - 1));
+	br->buf >>= nbits;
+	br->count -= nbits;
 	return result;
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+static int bits_overrun(const bit_reader* br)
 {
-	tree->tree2d = buffer;
+	return br->padding > br->count;
+}
 
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+static unsigned reverse_bits(unsigned code, unsigned length)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < length; i++) {
+		result = (result << 1) | ((code >> i) & 1);
+	}
+	return result;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/* build the decoding table of the canonical Huffman code given by the code lengths (as stored in the PNG file) */
+static void huffman_table_create(upng_t* upng, huffman_table* table, const unsigned* bitlen, unsigned numcodes)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
-	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
-
-	/* initialize local vectors */
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned subbits[1 << HUFFMAN_FAST_BITS];
+	unsigned bits, n, nsub = 0;
+	int left = 1;
+
 	memset(blcount, 0, sizeof(blcount));
-	memset(nextcode, 0, sizeof(nextcode));
+	memset(subbits, 0, sizeof(subbits));
+	memset(table->fast, 0, sizeof(table->fast));
 
-	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
+	/* count the codes of every length, and reject oversubscribed sets of lengths */
+	for (n = 0; n < numcodes; n++) {
+		if (bitlen[n] > MAX_BIT_LENGTH) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+		blcount[bitlen[n]]++;
+	}
+	blcount[0] = 0;
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		left = (left << 1) - (int)blcount[bits];
+		if (left < 0) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 	}
 
-	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
+	/* first canonical code of every length */
+	nextcode[0] = 0;
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
 		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
 	}
 
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
-		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
+	/* size the subtable of every primary prefix after its longest code */
+	for (n = 0; n < numcodes; n++) {
+		if (bitlen[n] > HUFFMAN_FAST_BITS) {
+			unsigned code = reverse_bits(nextcode[bitlen[n]], bitlen[n]);
+			unsigned prefix = code & HUFFMAN_FAST_MASK;
+			nextcode[bitlen[n]]++;
+			if (bitlen[n] - HUFFMAN_FAST_BITS > subbits[prefix]) {
+				subbits[prefix] = bitlen[n] - HUFFMAN_FAST_BITS;
+			}
 		}
 	}
-
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-	}
-
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
+	for (n = 0; n < (1u << HUFFMAN_FAST_BITS); n++) {
+		if (subbits[n] != 0) {
+			if (nsub + (1u << subbits[n]) > HUFFMAN_SUB_ENTRIES) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
-
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
-				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-			}
+			table->fast[n] = (nsub << 8) | HUFFMAN_SUBTABLE | subbits[n];
+			memset(table->sub + nsub, 0, sizeof(uint32_t) << subbits[n]);
+			nsub += 1u << subbits[n];
 		}
 	}
 
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+	/* fill every table slot whose low bits match a code (codes are stored
+	 * bit-reversed, as the stream delivers them LSB first) */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+	}
+	for (n = 0; n < numcodes; n++) {
+		unsigned length = bitlen[n];
+		unsigned code, entry, i;
+		if (length == 0) {
+			continue;
+		}
+		code = reverse_bits(nextcode[length]++, length);
+		entry = (n << 8) | length;
+		if (length <= HUFFMAN_FAST_BITS) {
+			for (i = code; i < (1u << HUFFMAN_FAST_BITS); i += 1u << length) {
+				table->fast[i] = entry;
+			}
+		} else {
+			uint32_t link = table->fast[code & HUFFMAN_FAST_MASK];
+			uint32_t* sub = table->sub + (link >> 8);
+			unsigned size = 1u << (link & 0x7F);
+			for (i = code >> HUFFMAN_FAST_BITS; i < size; i += 1u << (length - HUFFMAN_FAST_BITS)) {
+				sub[i] = entry;
+			}
 		}
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+/* decode one symbol; the caller makes sure the buffer holds at least MAX_BIT_LENGTH bits */
+static unsigned huffman_decode_symbol(upng_t* upng, bit_reader* br, const huffman_table* table)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
-
-		bit = read_bit(bp, in);
-
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
-		}
-
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	uint32_t entry = table->fast[br->buf & HUFFMAN_FAST_MASK];
+	if (entry & HUFFMAN_SUBTABLE) {
+		entry = table->sub[(entry >> 8) + ((br->buf >> HUFFMAN_FAST_BITS) & ((1u << (entry & 0x7F)) - 1))];
 	}
+	if ((entry & 0xFF) == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+	bits_get(br, entry & 0xFF);
+	return entry >> 8;
 }
 
-/* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+/* get the tables of a deflated block with dynamic codes, the code lengths themselves are also Huffman compressed */
+static void get_tables_inflate_dynamic(upng_t* upng, huffman_table* codetable, huffman_table* codetableD, bit_reader* br)
 {
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
-	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
-	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
-	unsigned n, hlit, hdist, hclen, i;
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS + NUM_DISTANCE_SYMBOLS];	/* lit/len lengths followed by the distance lengths */
+	huffman_table codelengthtable;
+	unsigned hlit, hdist, hclen, i;
 
-	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
+	memset(bitlen, 0, sizeof(bitlen));
+
+	bits_refill(br);
+	hlit = bits_get(br, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = bits_get(br, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = bits_get(br, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	if (hlit > 286 || hdist > 30) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	/* clear bitlen arrays */
-	memset(bitlen, 0, sizeof(bitlen));
-	memset(bitlenD, 0, sizeof(bitlenD));
-
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
-
+	/* up to 19 codes of 3 bits, 57 bits: more than one refill guarantees, so refill halfway */
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
-		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
-		} else {
-			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
+		if (i % 10 == 0) {
+			bits_refill(br);
 		}
+		codelengthcode[CLCL[i]] = i < hclen ? bits_get(br, 3) : 0;
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
-
-	/* bail now if we encountered an error earlier */
+	huffman_table_create(upng, &codelengthtable, codelengthcode, NUM_CODE_LENGTH_CODES);
 	if (upng->error != UPNG_EOK) {
 		return;
 	}
 
-	/*now we can use this tree to read the lengths for the tree that this function will return */
+	/*now we can use this table to read the lengths of the lit/len and distance codes */
 	i = 0;
-	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+	while (i < hlit + hdist) {
+		unsigned code, replength, value;
+
+		bits_refill(br);
+		code = huffman_decode_symbol(upng, br, &codelengthtable);
 		if (upng->error != UPNG_EOK) {
-			break;
+			return;
 		}
 
 		if (code <= 15) {	/*a length code */
-			if (i < hlit) {
-				bitlen[i] = code;
-			} else {
-				bitlenD[i - hlit] = code;
-			}
+			bitlen[i < hlit ? i : NUM_DEFLATE_CODE_SYMBOLS + i - hlit] = code;
 			i++;
-		} else if (code == 16) {	/*repeat previous */
-			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-			unsigned value;	/*set value to the previous code */
-
-			if ((*bp) >> 3 >= inlength) {
+			continue;
+		} else if (code == 16) {	/*repeat previous 3-6 times */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
-
-			if ((i - 1) < hlit) {
-				value = bitlen[i - 1];
-			} else {
-				value = bitlenD[i - hlit - 1];
-			}
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = value;
-				} else {
-					bitlenD[i - hlit] = value;
-				}
-				i++;
+				return;
 			}
+			replength = 3 + bits_get(br, 2);
+			value = bitlen[i - 1 < hlit ? i - 1 : NUM_DEFLATE_CODE_SYMBOLS + i - 1 - hlit];
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
-			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* error: i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = 0;
-				} else {
-					bitlenD[i - hlit] = 0;
-				}
-				i++;
-			}
-		} else if (code == 18) {	/*repeat "0" 11-138 times */
-			unsigned replength = 11;	/*read in the bits that indicate repeat length */
-			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
+			replength = 3 + bits_get(br, 3);
+			value = 0;
+		} else {	/*18: repeat "0" 11-138 times */
+			replength = 11 + bits_get(br, 7);
+			value = 0;
+		}
 
-			replength += read_bits(bp, in, 7);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-				if (i < hlit)
-					bitlen[i] = 0;
-				else
-					bitlenD[i - hlit] = 0;
-				i++;
-			}
-		} else {
-			/* somehow an unexisting code appeared. This can never happen. */
+		/* i is larger than the amount of codes */
+		if (i + replength > hlit + hdist) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			break;
+			return;
+		}
+		for (; replength > 0; replength--, i++) {
+			bitlen[i < hlit ? i : NUM_DEFLATE_CODE_SYMBOLS + i - hlit] = value;
 		}
 	}
 
-	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
+	/*the length of the end code 256 must be larger than 0 */
+	if (bitlen[256] == 0 || bits_overrun(br)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
 	}
 
-	/*the length of the end code 256 must be larger than 0 */
-	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
-	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
-	}
+	huffman_table_create(upng, codetable, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+		huffman_table_create(upng, codetableD, bitlen + NUM_DEFLATE_CODE_SYMBOLS, NUM_DISTANCE_SYMBOLS);
 	}
 }
 
-/*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+/* build the tables of the fixed codes of btype 1 */
+static void get_tables_inflate_fixed(upng_t* upng, huffman_table* codetable, huffman_table* codetableD)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
-	unsigned done = 0;
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned n;
 
-	huffman_tree codetree;
-	huffman_tree codetreeD;
+	for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+		bitlen[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+	}
+	for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+		bitlenD[n] = 5;
+	}
 
-	if (btype == 1) {
-		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-	} else if (btype == 2) {
-		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
+	huffman_table_create(upng, codetable, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
+	huffman_table_create(upng, codetableD, bitlenD, NUM_DISTANCE_SYMBOLS);
+}
+
+/*inflate a block with dynamic of fixed Huffman codes*/
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos, unsigned btype)
+{
+	huffman_table codetable;
+	huffman_table codetableD;
 
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+	if (btype == 1) {
+		get_tables_inflate_fixed(upng, &codetable, &codetableD);
+	} else {
+		get_tables_inflate_dynamic(upng, &codetable, &codetableD, br);
+	}
+	if (upng->error != UPNG_EOK) {
+		return;
 	}
 
-	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+	for (;;) {
+		unsigned code;
+
+		/* one refill covers the longest length/distance pair: 15 + 5 + 15 + 13 bits */
+		bits_refill(br);
+		if (bits_overrun(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		code = huffman_decode_symbol(upng, br, &codetable);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
 
-		if (code == 256) {
-			/* end code */
-			done = 1;
-		} else if (code <= 255) {
+		if (code <= 255) {
 			/* literal symbol */
 			if ((*pos) >= outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
-
-			/* store output */
 			out[(*pos)++] = (unsigned char)(code);
-		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
-			/* part 1: get length base */
-			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
-
-			/* part 2: get extra bits and add the value of that to length */
-			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
+		} else if (code == 256) {
+			/* end code */
+			return;
+		} else if (code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
+			unsigned long length, distance, backward;
+			unsigned codeD;
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-			length += read_bits(bp, in, numextrabits);
+			/* get length base and its extra bits */
+			length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX] + bits_get(br, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
-			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+			/* get distance code, base and extra bits (30-31 are never used) */
+			codeD = huffman_decode_symbol(upng, br, &codetableD);
 			if (upng->error != UPNG_EOK) {
 				return;
 			}
-
-			/* invalid distance code (30-31 are never used) */
 			if (codeD > 29) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
+			distance = DISTANCE_BASE[codeD] + bits_get(br, DISTANCE_EXTRA[codeD]);
 
-			distance = DISTANCE_BASE[codeD];
-
-			/*part 4: get extra bits from distance */
-			numextrabitsD = DISTANCE_EXTRA[codeD];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-
-			distance += read_bits(bp, in, numextrabitsD);
-
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
-
-			if ((*pos) + length >= outsize) {
+			if (distance > (*pos) || (*pos) + length > outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
-
-				if (backward >= start) {
-					backward = start - distance;
-				}
+			/* copy forward byte by byte, overlapping copies repeat the last "distance" bytes */
+			backward = (*pos) - distance;
+			while (length-- > 0) {
+				out[(*pos)++] = out[backward++];
 			}
+		} else {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos)
 {
-	unsigned long p;
-	unsigned len, nlen, n;
-
-	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
-	}
-	p = (*bp) / 8;		/*byte position */
-
-	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	unsigned len, nlen;
+
+	/* go to first boundary of byte, and read len (2 bytes) and nlen (2 bytes) */
+	bits_get(br, br->count & 7);
+	bits_refill(br);
+	len = bits_get(br, 16);
+	nlen = bits_get(br, 16);
+	if (bits_overrun(br)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
-	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
-	p += 2;
-
 	/* check if 16-bit nlen is really the one's complement of len */
 	if (len + nlen != 65535) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
 	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if ((*pos) + len > outsize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
+	/* first the bytes already in the bit buffer, then straight from the segments */
+	while (len > 0 && br->count > br->padding) {
+		out[(*pos)++] = (unsigned char)bits_get(br, 8);
+		len--;
+	}
+	if (len > 0) {
+		/* the buffer is empty; drop the bits the last word load read ahead */
+		br->buf = 0;
+	}
+	while (len > 0) {
+		unsigned long n;
+		if (br->pos == br->insize && !bits_next_segment(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+		n = br->insize - br->pos < len ? br->insize - br->pos : len;
+		memcpy(out + (*pos), br->in + br->pos, n);
+		(*pos) += n;
+		br->pos += n;
+		len -= n;
 	}
-
-	(*bp) = p * 8;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
 	unsigned long pos = 0;	/*byte position in the out buffer */
-
 	unsigned done = 0;
 
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
+		/* read block control bits, and ensure they don't point past the end of the buffer */
+		bits_refill(br);
+		done = bits_get(br, 1);
+		btype = bits_get(br, 2);
+		if (bits_overrun(br)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, outsize, br, &pos);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, outsize, br, &pos, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -640,10 +619,18 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 	return upng->error;
 }
 
-static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+/*inflate the zlib stream split across the IDAT chunks in [chunks, end)*/
+static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *chunks, const unsigned char *end)
 {
+	bit_reader br;
+	unsigned in[2];
+
 	/* we require two bytes for the zlib data header */
-	if (insize < 2) {
+	bits_init(&br, chunks, end);
+	bits_refill(&br);
+	in[0] = bits_get(&br, 8);
+	in[1] = bits_get(&br, 8);
+	if (bits_overrun(&br)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
@@ -667,7 +654,7 @@ static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long out
 	}
 
 	/* create output buffer */
-	uz_inflate_data(upng, out, outsize, in, insize, 2);
+	uz_inflate_data(upng, out, outsize, &br);
 
 	return upng->error;
 }
@@ -688,7 +675,127 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
-static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+#ifdef UPNG_SSE2
+static int cpu_has_sse2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] >> 26) & 1;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+/* load and store one 3 or 4 byte pixel in the low lane of a register */
+UPNG_TARGET_SSE2 static __m128i load_pixel(const unsigned char* p, unsigned long bytewidth)
+{
+	uint32_t v;
+	if (bytewidth == 4)
+		memcpy(&v, p, 4);
+	else
+		v = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+	return _mm_cvtsi32_si128((int)v);
+}
+
+UPNG_TARGET_SSE2 static void store_pixel(unsigned char* p, __m128i v, unsigned long bytewidth)
+{
+	uint32_t u = (uint32_t)_mm_cvtsi128_si32(v);
+	if (bytewidth == 4) {
+		memcpy(p, &u, 4);
+	} else {
+		p[0] = (unsigned char)u;
+		p[1] = (unsigned char)(u >> 8);
+		p[2] = (unsigned char)(u >> 16);
+	}
+}
+
+/* Sub, Average and Paeth depend on the pixel to the left, so they work one
+   pixel at a time with every channel in its own lane; Up has no such
+   dependency and works 16 bytes at a time */
+UPNG_TARGET_SSE2 static void unfilter_sub_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long bytewidth, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+
+	for (i = 0; i < length; i += bytewidth) {
+		a = _mm_add_epi8(a, load_pixel(scanline + i, bytewidth));
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+UPNG_TARGET_SSE2 static void unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+		_mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+	}
+	for (; i < length; i++)
+		recon[i] = scanline[i] + precon[i];
+}
+
+UPNG_TARGET_SSE2 static void unfilter_avg_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = load_pixel(precon + i, bytewidth);
+		/* _mm_avg_epu8 rounds up, take the rounding back where a + b is odd */
+		__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(avg, load_pixel(scanline + i, bytewidth));
+		store_pixel(recon + i, a, bytewidth);
+	}
+}
+
+UPNG_TARGET_SSE2 static __m128i abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+UPNG_TARGET_SSE2 static __m128i select_si128(__m128i mask, __m128i t, __m128i e)
+{
+	return _mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, e));
+}
+
+UPNG_TARGET_SSE2 static void unfilter_paeth_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;	/* left and upper left pixels, 16 bits per channel */
+	__m128i d = zero;
+	unsigned long i;
+
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(precon + i, bytewidth), zero);
+		/* same distances as paeth_predictor(): |p - a| = |b - c|, |p - b| = |a - c|, |p - c| = |a + b - 2c| */
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = _mm_add_epi16(pa, pb);
+		__m128i smallest, nearest;
+
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+		pc = abs_epi16(pc);
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+		/* ties favor a over b over c */
+		nearest = select_si128(_mm_cmpeq_epi16(smallest, pa), a,
+			select_si128(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		d = _mm_add_epi8(load_pixel(scanline + i, bytewidth), _mm_packus_epi16(nearest, nearest));
+		store_pixel(recon + i, d, bytewidth);
+
+		a = _mm_unpacklo_epi8(d, zero);
+		c = b;
+	}
+}
+#endif
+
+static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length, int simd)
 {
 	/*
 	   For PNG filter method 0
@@ -696,9 +803,41 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	   precon is the previous unfiltered scanline, recon the result, scanline the current one
 	   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
 	   recon and scanline MAY be the same memory address! precon must be disjoint.
+	   simd picks the SSE2 paths, used for 3 and 4 byte pixels (8 bit RGB and RGBA) where they are available
 	 */
 
 	unsigned long i;
+
+#ifdef UPNG_SSE2
+	if (simd && (bytewidth == 3 || bytewidth == 4)) {
+		switch (filterType) {
+		case 1:
+			unfilter_sub_sse2(recon, scanline, bytewidth, length);
+			return;
+		case 2:
+			if (precon) {
+				unfilter_up_sse2(recon, scanline, precon, length);
+				return;
+			}
+			break;
+		case 3:
+			if (precon) {
+				unfilter_avg_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			}
+			break;
+		case 4:
+			if (precon) {
+				unfilter_paeth_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			}
+			break;
+		}
+	}
+#else
+	(void)simd;
+#endif
+
 	switch (filterType) {
 	case 0:
 		for (i = 0; i < length; i++)
@@ -762,6 +901,11 @@ static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in,
 
 	unsigned y;
 	unsigned char *prevline = 0;
+#ifdef UPNG_SSE2
+	int simd = cpu_has_sse2();
+#else
+	int simd = 0;
+#endif
 
 	unsigned long bytewidth = (bpp + 7) / 8;	/*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise */
 	unsigned long linebytes = (w * bpp + 7) / 8;
@@ -771,7 +915,7 @@ static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in,
 		unsigned long inindex = (1 + linebytes) * y;	/*the extra filterbyte added to each row */
 		unsigned char filterType = in[inindex];
 
-		unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes);
+		unfilter_scanline(upng, &out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes, simd);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
@@ -876,15 +1020,59 @@ static upng_format determine_format(upng_t* upng) {
 		default:
 			return UPNG_BADFORMAT;
 		}
+	case UPNG_PAL:
+		/* palette images are expanded to RGBA8 by upng_decode */
+		switch (upng->color_depth) {
+		case 1:
+		case 2:
+		case 4:
+		case 8:
+			return UPNG_RGBA8;
+		default:
+			return UPNG_BADFORMAT;
+		}
 	default:
 		return UPNG_BADFORMAT;
 	}
 }
 
+/*replace the palette indices in upng->buffer with their RGBA8 palette entries*/
+static void expand_palette(upng_t* upng)
+{
+	unsigned depth = upng->color_depth;
+	unsigned long npixels = (unsigned long)upng->width * upng->height;
+	unsigned long i;
+	unsigned char* rgba;
+
+	rgba = (unsigned char*)UPNG_ALLOC(upng, npixels * 4);
+	if (rgba == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return;
+	}
+
+	/* post_process_scanlines already removed the padding bits, so the indices are one continuous bitstream */
+	for (i = 0; i < npixels; i++) {
+		unsigned long bit = i * depth;
+		unsigned index = (upng->buffer[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+		if (index >= upng->palette_size) {
+			UPNG_FREE(upng, rgba);
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+		memcpy(rgba + i * 4, upng->palette + index * 4, 4);
+	}
+
+	UPNG_FREE(upng, upng->buffer);
+	upng->buffer = rgba;
+	upng->size = npixels * 4;
+	upng->color_type = UPNG_RGBA;
+	upng->color_depth = 8;
+}
+
 static void upng_free_source(upng_t* upng)
 {
 	if (upng->source.owning != 0) {
-		free((void*)upng->source.buffer);
+		UPNG_FREE(upng, upng->source.buffer);
 	}
 
 	upng->source.buffer = NULL;
@@ -964,9 +1152,7 @@ upng_error upng_header(upng_t* upng)
 upng_error upng_decode(upng_t* upng)
 {
 	const unsigned char *chunk;
-	unsigned char* compressed;
 	unsigned char* inflated;
-	unsigned long compressed_size = 0, compressed_index = 0;
 	unsigned long inflated_size;
 	upng_error error;
 
@@ -988,7 +1174,7 @@ upng_error upng_decode(upng_t* upng)
 
 	/* release old result, if any */
 	if (upng->buffer != 0) {
-		free(upng->buffer);
+		UPNG_FREE(upng, upng->buffer);
 		upng->buffer = 0;
 		upng->size = 0;
 	}
@@ -996,8 +1182,8 @@ upng_error upng_decode(upng_t* upng)
 	/* first byte of the first chunk after the header */
 	chunk = upng->source.buffer + 33;
 
-	/* scan through the chunks, finding the size of all IDAT chunks, and also
-	 * verify general well-formed-ness */
+	/* scan through the chunks, reading the palette, and verify general
+	 * well-formed-ness */
 	while (chunk < upng->source.buffer + upng->source.size) {
 		unsigned long length;
 		// const unsigned char *data;	/*the data in the chunk */
@@ -1026,7 +1212,30 @@ upng_error upng_decode(upng_t* upng)
 
 		/* parse chunks */
 		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			compressed_size += length;
+			/* inflated in place from the source later */
+		} else if (upng_chunk_type(chunk) == CHUNK_PLTE) {
+			unsigned long i;
+			if (length % 3 != 0 || length / 3 > 256) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return upng->error;
+			}
+			upng->palette_size = length / 3;
+			for (i = 0; i < upng->palette_size; i++) {
+				upng->palette[i * 4 + 0] = chunk[8 + i * 3 + 0];
+				upng->palette[i * 4 + 1] = chunk[8 + i * 3 + 1];
+				upng->palette[i * 4 + 2] = chunk[8 + i * 3 + 2];
+				upng->palette[i * 4 + 3] = 255;
+			}
+		} else if (upng_chunk_type(chunk) == CHUNK_TRNS && upng->color_type == UPNG_PAL) {
+			/* tRNS comes after PLTE and holds one alpha value per leading palette entry */
+			unsigned long i;
+			if (length > upng->palette_size) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return upng->error;
+			}
+			for (i = 0; i < length; i++) {
+				upng->palette[i * 4 + 3] = chunk[8 + i];
+			}
 		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
 			break;
 		} else if (upng_chunk_critical(chunk)) {
@@ -1037,59 +1246,31 @@ upng_error upng_decode(upng_t* upng)
 		chunk += upng_chunk_length(chunk) + 12;
 	}
 
-	/* allocate enough space for the (compressed and filtered) image data */
-	compressed = (unsigned char*)malloc(compressed_size);
-	if (compressed == NULL) {
-		SET_ERROR(upng, UPNG_ENOMEM);
+	if (upng->color_type == UPNG_PAL && upng->palette_size == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
 		return upng->error;
 	}
 
-	/* scan through the chunks again, this time copying the values into
-	 * our compressed buffer.  there's no reason to validate anything a second time. */
-	chunk = upng->source.buffer + 33;
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
-
-		length = upng_chunk_length(chunk);
-		data = chunk + 8;
-
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			memcpy(compressed + compressed_index, data, length);
-			compressed_index += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		}
-
-		chunk += upng_chunk_length(chunk) + 12;
-	}
-
 	/* allocate space to store inflated (but still filtered) data */
 	inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
-	inflated = (unsigned char*)malloc(inflated_size);
+	inflated = (unsigned char*)UPNG_ALLOC(upng, inflated_size);
 	if (inflated == NULL) {
-		free(compressed);
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
 	}
 
-	/* decompress image data */
-	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
+	/* decompress image data, streaming the IDAT chunks without concatenating them */
+	error = uz_inflate(upng, inflated, inflated_size, upng->source.buffer + 33, upng->source.buffer + upng->source.size);
 	if (error != UPNG_EOK) {
-		free(compressed);
-		free(inflated);
+		UPNG_FREE(upng, inflated);
 		return upng->error;
 	}
 
-	/* free the compressed compressed data */
-	free(compressed);
-
 	/* allocate final image buffer */
 	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
-	upng->buffer = (unsigned char*)malloc(upng->size);
+	upng->buffer = (unsigned char*)UPNG_ALLOC(upng, upng->size);
 	if (upng->buffer == NULL) {
-		free(inflated);
+		UPNG_FREE(upng, inflated);
 		upng->size = 0;
 		SET_ERROR(upng, UPNG_ENOMEM);
 		return upng->error;
@@ -1097,10 +1278,14 @@ upng_error upng_decode(upng_t* upng)
 
 	/* unfilter scanlines */
 	post_process_scanlines(upng, upng->buffer, inflated, upng);
-	free(inflated);
+	UPNG_FREE(upng, inflated);
+
+	if (upng->error == UPNG_EOK && upng->color_type == UPNG_PAL) {
+		expand_palette(upng);
+	}
 
 	if (upng->error != UPNG_EOK) {
-		free(upng->buffer);
+		UPNG_FREE(upng, upng->buffer);
 		upng->buffer = NULL;
 		upng->size = 0;
 	} else {
@@ -1113,15 +1298,35 @@ upng_error upng_decode(upng_t* upng)
 	return upng->error;
 }
 
-static upng_t* upng_new(void)
+static void* upng_default_alloc(void* user, unsigned long size)
+{
+	(void)user;
+	return malloc(size);
+}
+
+static void upng_default_free(void* user, void* ptr)
+{
+	(void)user;
+	free(ptr);
+}
+
+static const upng_allocator upng_default_allocator = { upng_default_alloc, upng_default_free, NULL };
+
+static upng_t* upng_new(const upng_allocator* allocator)
 {
 	upng_t* upng;
 
-	upng = (upng_t*)malloc(sizeof(upng_t));
+	if (allocator == NULL) {
+		allocator = &upng_default_allocator;
+	}
+
+	upng = (upng_t*)allocator->alloc(allocator->user, sizeof(upng_t));
 	if (upng == NULL) {
 		return NULL;
 	}
 
+	upng->allocator = *allocator;
+
 	upng->buffer = NULL;
 	upng->size = 0;
 
@@ -1140,12 +1345,19 @@ static upng_t* upng_new(void)
 	upng->source.size = 0;
 	upng->source.owning = 0;
 
+	upng->palette_size = 0;
+
 	return upng;
 }
 
 upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
 {
-	upng_t* upng = upng_new();
+	return upng_new_from_bytes_with_allocator(buffer, size, NULL);
+}
+
+upng_t* upng_new_from_bytes_with_allocator(const unsigned char* buffer, unsigned long size, const upng_allocator* allocator)
+{
+	upng_t* upng = upng_new(allocator);
 	if (upng == NULL) {
 		return NULL;
 	}
@@ -1158,13 +1370,18 @@ upng_t* upng_new_from_bytes(const unsigned char* buffer, unsigned long size)
 }
 
 upng_t* upng_new_from_file(const char *filename)
+{
+	return upng_new_from_file_with_allocator(filename, NULL);
+}
+
+upng_t* upng_new_from_file_with_allocator(const char *filename, const upng_allocator* allocator)
 {
 	upng_t* upng;
 	unsigned char *buffer;
 	FILE *file;
 	long size;
 
-	upng = upng_new();
+	upng = upng_new(allocator);
 	if (upng == NULL) {
 		return NULL;
 	}
@@ -1181,7 +1398,7 @@ upng_t* upng_new_from_file(const char *filename)
 	rewind(file);
 
 	/* read contents of the file into the vector */
-	buffer = (unsigned char *)malloc((unsigned long)size);
+	buffer = (unsigned char *)UPNG_ALLOC(upng, (unsigned long)size);
 	if (buffer == NULL) {
 		fclose(file);
 		SET_ERROR(upng, UPNG_ENOMEM);
@@ -1200,16 +1417,18 @@ upng_t* upng_new_from_file(const char *filename)
 
 void upng_free(upng_t* upng)
 {
+	upng_allocator allocator = upng->allocator;
+
 	/* deallocate image buffer */
 	if (upng->buffer != NULL) {
-		free(upng->buffer);
+		UPNG_FREE(upng, upng->buffer);
 	}
 
 	/* deallocate source buffer, if necessary */
 	upng_free_source(upng);
 
 	/* deallocate struct itself */
-	free(upng);
+	allocator.free(allocator.user, upng);
 }
 
 upng_error upng_get_error(const upng_t* upng)
@@ -1244,6 +1463,8 @@ unsigned upng_get_components(const upng_t* upng)
 		return 1;
 	case UPNG_RGB:
 		return 3;
+	case UPNG_PAL:
+		return 1;
 	case UPNG_LUMA:
 		return 2;
 	case UPNG_RGBA:
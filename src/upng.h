@@ -57,8 +57,19 @@ typedef enum upng_format {
 
 typedef struct upng_t upng_t;
 
+/* memory for the upng_t, the source copy, and every buffer of the decode,
+ * including the decoded image; free is called for everything alloc returned,
+ * at the latest by upng_free */
+typedef struct upng_allocator {
+	void*	(*alloc)	(void* user, unsigned long size);
+	void	(*free)		(void* user, void* ptr);
+	void*	user;
+} upng_allocator;
+
 upng_t*		upng_new_from_bytes	(const unsigned char* buffer, unsigned long size);
 upng_t*		upng_new_from_file	(const char* path);
+upng_t*		upng_new_from_bytes_with_allocator	(const unsigned char* buffer, unsigned long size, const upng_allocator* allocator);
+upng_t*		upng_new_from_file_with_allocator	(const char* path, const upng_allocator* allocator);
 void		upng_free			(upng_t* upng);
 
 upng_error	upng_header			(upng_t* upng);
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "embeddedtextures.h"
+#include "upng.h"
+
+#define TEXELS_PER_LINE 8
+
+/*
+ * Embedded textures generator
+ * -------------------
+ * Decodes PNG files and writes them as a C source file of constant texel
+ * arrays, for builds with EMBEDDED_ASSETS:
+ * 
+ *   embed_textures [output file] png files...
+ * 
+ * Defaults to EMBEDDED_TEXTURES_FILE. Textures are looked up by file
+ * name, so the directories of the inputs don't matter. The texels are
+ * const, so the linker places them in read-only pages shared by every
+ * running copy of the game.
+ */
+
+static const char* getFileName(const char* path) {
+    const char* slash = strrchr(path, '/');
+    const char* backslash = strrchr(path, '\\');
+    if (backslash != NULL && (slash == NULL || backslash > slash))
+        slash = backslash;
+    return slash != NULL ? slash + 1 : path;
+}
+
+/*
+ * Function: writeTexels
+ * -------------------
+ * Writes the texel array of one texture
+ * 
+ * FILE* file: Output file
+ * int i: Texture number, names the array
+ * const uint32_t* pixels: Decoded texels
+ * int numTexels: Number of texels
+ * 
+ * returns: true/false if the operation succeeded
+ */
+static bool writeTexels(FILE* file, int i, const uint32_t* pixels, int numTexels) {
+    fprintf(file, "static const uint32_t texels%d[%d] __attribute__((aligned(%d))) = {",
+        i, numTexels, EMBEDDED_TEXTURES_ALIGNMENT);
+    for (int t = 0; t < numTexels; t++) {
+        if (t % TEXELS_PER_LINE == 0)
+            fprintf(file, "\n   ");
+        fprintf(file, " 0x%08X,", (unsigned)pixels[t]);
+    }
+    return fprintf(file, "\n};\n\n") > 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char* outputPath = argc > 1 ? argv[1] : EMBEDDED_TEXTURES_FILE;
+    int numInputs = argc > 2 ? argc - 2 : 0;
+    static int widths[1024], heights[1024];
+    if (numInputs > 1024) {
+        fprintf(stderr, "Too many textures\n");
+        return 1;
+    }
+
+    FILE* file = fopen(outputPath, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating %s\n", outputPath);
+        return 1;
+    }
+    fprintf(file, "// Generated by embed_textures, do not edit\n");
+    fprintf(file, "#include <stdint.h>\n#include \"embeddedtextures.h\"\n\n");
+
+    size_t totalSize = 0;
+    bool ok = true;
+    for (int i = 0; i < numInputs && ok; i++) {
+        const char* path = argv[i + 2];
+        upng_t* upng = upng_new_from_file(path);
+        if (upng == NULL || upng_decode(upng) != UPNG_EOK || upng_get_format(upng) != UPNG_RGBA8) {
+            fprintf(stderr, "Error decoding %s\n", path);
+            ok = false;
+        } else {
+            widths[i] = upng_get_width(upng);
+            heights[i] = upng_get_height(upng);
+            ok = writeTexels(file, i, (const uint32_t*)upng_get_buffer(upng), widths[i] * heights[i]);
+            totalSize += (size_t)widths[i] * heights[i] * sizeof(uint32_t);
+        }
+        if (upng != NULL)
+            upng_free(upng);
+    }
+
+    if (ok) {
+        fprintf(file, "const embedded_texture_t embeddedTextures[] = {\n");
+        for (int i = 0; i < numInputs; i++)
+            fprintf(file, "    { \"%s\", %d, %d, texels%d },\n", getFileName(argv[i + 2]), widths[i], heights[i], i);
+        if (numInputs == 0)
+            fprintf(file, "    { \"\", 0, 0, 0 }\n");
+        fprintf(file, "};\n\nconst int numEmbeddedTextures = %d;\n", numInputs);
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error writing %s\n", outputPath);
+        remove(outputPath);
+        return 1;
+    }
+
+    printf("Embedded %d textures (%zu bytes) into %s\n", numInputs, totalSize, outputPath);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "framering.h"
+
+/*
+ * Frame ring reader
+ * -------------------
+ * Follows the frames a running game publishes with --shm:
+ * 
+ *   frame_reader [ring name] [frames]
+ * 
+ * Defaults to FRAME_RING_NAME, and to reading until the game exits. Each
+ * frame is read in place, without copying it out of shared memory, and
+ * printed with its pose, its delay since it was published and a checksum
+ * of its pixels. Frames overwritten before they were reached count as
+ * dropped, frames overwritten while being read as torn.
+ */
+
+static uint64_t getTimestamp(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// FNV-1a over the pixels
+static uint32_t hashPixels(const uint32_t* pixels, int count) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < count; i++)
+        hash = (hash ^ pixels[i]) * 16777619u;
+    return hash;
+}
+
+int main(int argc, char *argv[]) {
+    const char* name = argc > 1 ? argv[1] : FRAME_RING_NAME;
+    long maxFrames = argc > 2 ? atol(argv[2]) : 0;
+    frame_ring_t ring;
+    if (!openFrameRing(&ring, name))
+        return 1;
+
+    const frame_ring_header_t* header = ring.header;
+    int numPixels = header->width * header->height;
+    uint32_t numSlots = header->numSlots;
+    printf("%s: %dx%d frames, %u slots\n", name, header->width, header->height, numSlots);
+
+    long numRead = 0, numDropped = 0, numTorn = 0;
+    uint32_t next = getPublishedFrames(&ring);
+    while (maxFrames == 0 || numRead < maxFrames) {
+        uint32_t published = getPublishedFrames(&ring);
+        if (next == published) {
+            if (SDL_AtomicGet(&ring.header->closed))
+                break;
+            SDL_Delay(1);
+            continue;
+        }
+
+        // The slot of frame n is reused for frame n + numSlots
+        if (published - next >= numSlots) {
+            numDropped += published - next - (numSlots - 1);
+            next = published - (numSlots - 1);
+        }
+        const frame_ring_slot_t* slot = peekFrame(&ring, next);
+        if (slot == NULL) {
+            numDropped++;
+            next++;
+            continue;
+        }
+
+        uint32_t hash = hashPixels(getFramePixels(slot), numPixels);
+        double delay = (getTimestamp() - slot->timestamp) / 1e6;
+        float x = slot->x, y = slot->y, angle = slot->angle;
+        if (isFrameIntact(slot, next)) {
+            printf("frame %6u: pose (%7.1f, %7.1f, %5.2f), %6.3f ms after publishing, hash %08x\n",
+                next, x, y, angle, delay, hash);
+            numRead++;
+        } else {
+            numTorn++;
+        }
+        setConsumedFrames(&ring, ++next);
+    }
+
+    printf("%ld frames read, %ld dropped, %ld torn\n", numRead, numDropped, numTorn);
+    closeFrameRing(&ring);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "assetpack.h"
+#include "mapfile.h"
+
+#define MAX_ASSETS 1024
+
+/*
+ * Asset pack builder
+ * -------------------
+ * Packs every file of the assets directory into one asset pack:
+ * 
+ *   pack_assets [assets directory] [pack file]
+ * 
+ * Defaults to ./assets and ASSET_PACK_FILE. Hidden files, the decoded
+ * texture cache and the pack itself are left out. PNG files are packed as
+ * images and .map files as maps, anything else as raw data.
+ */
+
+static bool endsWith(const char* name, const char* suffix) {
+    size_t nameLength = strlen(name), suffixLength = strlen(suffix);
+    return nameLength >= suffixLength && strcmp(name + nameLength - suffixLength, suffix) == 0;
+}
+
+static asset_type_t getTypeFromName(const char* name) {
+    if (endsWith(name, ".png"))
+        return ASSET_IMAGE;
+    if (endsWith(name, ".map"))
+        return ASSET_MAP;
+    return ASSET_RAW;
+}
+
+int main(int argc, char *argv[]) {
+    const char* directory = argc > 1 ? argv[1] : "./assets";
+    const char* packPath = argc > 2 ? argv[2] : ASSET_PACK_FILE;
+    const char* packName = strrchr(packPath, '/') != NULL ? strrchr(packPath, '/') + 1 : packPath;
+
+    static asset_pack_item_t items[MAX_ASSETS];
+    static mapped_file_t files[MAX_ASSETS];
+    static char names[MAX_ASSETS][ASSET_PACK_NAME_LENGTH];
+    int numItems = 0;
+    size_t totalSize = 0;
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Error opening directory %s\n", directory);
+        return 1;
+    }
+
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        const char* name = dirEntry->d_name;
+        char path[1024];
+        if (name[0] == '.' || strncmp(name, packName, strlen(packName)) == 0
+            || strncmp(name, "textures.cache", strlen("textures.cache")) == 0)
+            continue;
+        if (numItems == MAX_ASSETS || strlen(name) >= ASSET_PACK_NAME_LENGTH) {
+            fprintf(stderr, "Skipping %s: too many assets or name too long\n", name);
+            continue;
+        }
+
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", directory, name);
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode) || !mapFile(path, &files[numItems]))
+            continue;   // Directories, empty or unreadable files
+
+        strcpy(names[numItems], name);
+        items[numItems].name = names[numItems];
+        items[numItems].type = getTypeFromName(name);
+        items[numItems].data = files[numItems].data;
+        items[numItems].size = files[numItems].size;
+        totalSize += files[numItems].size;
+        numItems++;
+    }
+    closedir(dir);
+
+    bool ok = writeAssetPack(packPath, items, numItems);
+    for (int i = 0; i < numItems; i++)
+        unmapFile(&files[i]);
+    if (!ok)
+        return 1;
+
+    printf("Packed %d assets (%zu bytes) into %s\n", numItems, totalSize, packPath);
+    return 0;
+}